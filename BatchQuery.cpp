@@ -0,0 +1,124 @@
+#include "BatchQuery.h"
+
+#include "HierarchicalGrid.h"
+#include "Triangle.h"
+
+#include <algorithm>
+
+BatchQuery::BatchQuery(int packetSize)
+	: m_packetSize(packetSize)
+	, m_packetCount(0)
+{
+	m_hitOffsets.push_back(0);
+}
+
+void BatchQuery::Run(std::vector<Triangle>& queries, std::vector<Triangle>& staticTriangles, const HierarchicalGrid& grid)
+{
+	const int queryCount = static_cast<int>(queries.size());
+
+	m_touched.clear();
+	m_hitQueries.clear();
+	m_hitStatics.clear();
+	m_packetCount = 0;
+
+	// morton order of the query centers, quantized inside the bounds of all queries
+	glm::vec2 min(99999999, 99999999);
+	glm::vec2 max(-99999999, -99999999);
+
+	for (int i = 0; i < queryCount; ++i)
+	{
+		glm::vec2 center = queries[i].position + queries[i].bCircleCenter;
+		min = glm::min(min, center);
+		max = glm::max(max, center);
+	}
+
+	glm::vec2 extent = glm::max(max - min, glm::vec2(1.0f, 1.0f));
+	glm::vec2 scale = glm::vec2(65535.0f, 65535.0f) / extent;
+
+	m_sortKeys.resize(queryCount);
+	for (int i = 0; i < queryCount; ++i)
+	{
+		glm::vec2 cell = (queries[i].position + queries[i].bCircleCenter - min) * scale;
+		unsigned long long code = MortonCode(static_cast<unsigned int>(cell.x), static_cast<unsigned int>(cell.y));
+
+		// index in the lower bits, the sort carries it along
+		m_sortKeys[i] = (code << 32) | static_cast<unsigned int>(i);
+	}
+
+	std::sort(m_sortKeys.begin(), m_sortKeys.end());
+
+	for (int packetStart = 0; packetStart < queryCount; packetStart += m_packetSize)
+	{
+		const int packetEnd = std::min(packetStart + m_packetSize, queryCount);
+		++m_packetCount;
+
+		// one traversal for the bounds of the whole packet
+		glm::vec2 packetMin(99999999, 99999999);
+		glm::vec2 packetMax(-99999999, -99999999);
+
+		for (int k = packetStart; k < packetEnd; ++k)
+		{
+			const Triangle& query = queries[static_cast<int>(m_sortKeys[k] & 0xffffffff)];
+			glm::vec2 center = query.position + query.bCircleCenter;
+			glm::vec2 radius(query.bCircleRadius, query.bCircleRadius);
+
+			packetMin = glm::min(packetMin, center - radius);
+			packetMax = glm::max(packetMax, center + radius);
+		}
+
+		grid.QueryRect(packetMin, packetMax, m_candidates);
+		m_touched.insert(m_touched.end(), m_candidates.begin(), m_candidates.end());
+
+		for (int k = packetStart; k < packetEnd; ++k)
+		{
+			const int queryIndex = static_cast<int>(m_sortKeys[k] & 0xffffffff);
+			Triangle& query = queries[queryIndex];
+			query.collisionStatus = CollisionStatus::None;
+
+			for (size_t c = 0; c < m_candidates.size(); ++c)
+			{
+				if (query.TestCollision(staticTriangles[m_candidates[c]]))
+				{
+					m_hitQueries.push_back(queryIndex);
+					m_hitStatics.push_back(m_candidates[c]);
+				}
+			}
+		}
+	}
+
+	// counting sort of the hits by query
+	m_hitOffsets.assign(queryCount + 1, 0);
+	for (size_t i = 0; i < m_hitQueries.size(); ++i)
+	{
+		++m_hitOffsets[m_hitQueries[i] + 1];
+	}
+
+	for (int i = 0; i < queryCount; ++i)
+	{
+		m_hitOffsets[i + 1] += m_hitOffsets[i];
+	}
+
+	m_hits.resize(m_hitQueries.size());
+	std::vector<int> fill(m_hitOffsets.begin(), m_hitOffsets.end() - 1);
+
+	for (size_t i = 0; i < m_hitQueries.size(); ++i)
+	{
+		m_hits[fill[m_hitQueries[i]]++] = m_hitStatics[i];
+	}
+}
+
+unsigned int BatchQuery::MortonCode(unsigned int x, unsigned int y)
+{
+	return SpreadBits(x) | (SpreadBits(y) << 1);
+}
+
+// inserts a zero bit between each of the lower 16 bits
+unsigned int BatchQuery::SpreadBits(unsigned int value)
+{
+	value &= 0x0000ffff;
+	value = (value | (value << 8)) & 0x00ff00ff;
+	value = (value | (value << 4)) & 0x0f0f0f0f;
+	value = (value | (value << 2)) & 0x33333333;
+	value = (value | (value << 1)) & 0x55555555;
+	return value;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+struct Triangle;
+class HierarchicalGrid;
+
+/**
+ * Tests many moving triangles against the static set in one call
+ * The queries are sorted by the morton code of their center and cut into
+ * packets of neighbouring queries. Every packet does a single grid traversal
+ * for the union of its bounds, the candidates are then shared by all queries
+ * of the packet instead of traversing the grid once per query.
+ */
+class BatchQuery
+{
+public:
+	explicit BatchQuery(int packetSize = 16);
+
+	void Run(std::vector<Triangle>& queries, std::vector<Triangle>& staticTriangles, const HierarchicalGrid& grid);
+
+	// intersecting static triangles of queries[query]
+	int GetHitCount(int query) const { return m_hitOffsets[query + 1] - m_hitOffsets[query]; }
+	const int* GetHits(int query) const { return m_hits.data() + m_hitOffsets[query]; }
+	int GetTotalHitCount(void) const { return static_cast<int>(m_hits.size()); }
+
+	// every static triangle that was a candidate of any packet, may contain duplicates
+	const std::vector<int>& GetTouched(void) const { return m_touched; }
+
+	int GetPacketCount(void) const { return m_packetCount; }
+
+private:
+	static unsigned int MortonCode(unsigned int x, unsigned int y);
+	static unsigned int SpreadBits(unsigned int value);
+
+	int m_packetSize;
+	int m_packetCount;
+
+	std::vector<unsigned long long> m_sortKeys;
+	std::vector<int> m_candidates;
+	std::vector<int> m_touched;
+
+	// hits as (query, static index) in packet order, compacted per query afterwards
+	std::vector<int> m_hitQueries;
+	std::vector<int> m_hitStatics;
+
+	std::vector<int> m_hitOffsets;
+	std::vector<int> m_hits;
+};
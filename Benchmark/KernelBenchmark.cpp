@@ -0,0 +1,382 @@
+#include "../Collision.h"
+#include "../GiftWrapping.h"
+#include "../Triangle.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * Microbenchmarks of the single collision kernels on pre-generated pair sets
+ *
+ * usage: KernelBenchmark [--save <file>] [--compare <file>] [--threshold <percent>]
+ *   --save       writes the results as new baseline
+ *   --compare    compares against a baseline, exits with 1 if any kernel got slower than the threshold (default 10%)
+ */
+
+// allocation counting for allocs/op
+static std::atomic<unsigned long long> s_allocations(0);
+
+void* operator new(size_t size)
+{
+	s_allocations.fetch_add(1, std::memory_order_relaxed);
+
+	if (void* memory = std::malloc(size ? size : 1))
+		return memory;
+
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+	std::free(memory);
+}
+
+struct Pair
+{
+	Triangle triangle1;
+	Triangle triangle2;
+	bool overlapping;
+
+	// inputs of the hull and point kernels
+	std::vector<glm::vec2> minkowskiPoints;
+	std::vector<glm::vec2> minkowskiHull;
+};
+
+struct Result
+{
+	std::string kernel;
+	std::string scenario;
+	double nsPerOp;
+	double allocsPerOp;
+	double hitRatio;
+};
+
+static const int PairCount = 2048;
+static const double MinSeconds = 0.2;
+
+static std::mt19937 s_random(1234);
+
+static glm::vec2 Centroid(const Triangle& triangle)
+{
+	return triangle.position + (triangle.relativeP0 + triangle.relativeP1 + triangle.relativeP2) / 3.0f;
+}
+
+static glm::vec2 RandomDirection(void)
+{
+	float angle = std::uniform_real_distribution<float>(0.0f, 6.2831853f)(s_random);
+	return glm::vec2(std::cos(angle), std::sin(angle));
+}
+
+static Triangle RandomTriangle(void)
+{
+	Triangle triangle = Triangle::GenerateRandom({ 100.0f, 100.0f }, { 0.0f, 0.0f });
+	triangle.SetRotation(std::uniform_real_distribution<float>(0.0f, 6.2831853f)(s_random));
+	return triangle;
+}
+
+// places triangle2 so its centroid is at the given distance from the centroid of triangle1
+static void Place(const Triangle& triangle1, Triangle& triangle2, const glm::vec2& direction, float distance)
+{
+	triangle2.position = { 0.0f, 0.0f };
+	triangle2.position = Centroid(triangle1) + direction * distance - Centroid(triangle2);
+}
+
+static void FinishPair(Pair& pair)
+{
+	pair.overlapping = CollisionChecks::Minkowski(pair.triangle1, pair.triangle2);
+
+	const Triangle& t1 = pair.triangle1;
+	const Triangle& t2 = pair.triangle2;
+	glm::vec2 p1[3] = { t1.position + t1.relativeP0, t1.position + t1.relativeP1, t1.position + t1.relativeP2 };
+	glm::vec2 p2[3] = { t2.position + t2.relativeP0, t2.position + t2.relativeP1, t2.position + t2.relativeP2 };
+
+	for (int i = 0; i < 3; ++i)
+	{
+		for (int j = 0; j < 3; ++j)
+		{
+			pair.minkowskiPoints.push_back(p1[i] - p2[j]);
+		}
+	}
+
+	std::vector<glm::vec2> points = pair.minkowskiPoints;
+	GiftWrapping convexHull(points);
+	convexHull.OptimizedCalc();
+	pair.minkowskiHull = convexHull.GetHull();
+}
+
+static Pair SeparatedPair(void)
+{
+	Pair pair;
+	pair.triangle1 = RandomTriangle();
+	pair.triangle2 = RandomTriangle();
+	Place(pair.triangle1, pair.triangle2, RandomDirection(), 3.0f * (pair.triangle1.bCircleRadius + pair.triangle2.bCircleRadius));
+	FinishPair(pair);
+	return pair;
+}
+
+static Pair OverlappingPair(void)
+{
+	// centroids are inside both triangles
+	Pair pair;
+	pair.triangle1 = RandomTriangle();
+	pair.triangle2 = RandomTriangle();
+	Place(pair.triangle1, pair.triangle2, RandomDirection(), 0.0f);
+	FinishPair(pair);
+	return pair;
+}
+
+// bisects the distance at which the triangles stop intersecting and places them just in front of or behind it
+static Pair NearTouchingPair(void)
+{
+	Pair pair;
+	pair.triangle1 = RandomTriangle();
+	pair.triangle2 = RandomTriangle();
+
+	glm::vec2 direction = RandomDirection();
+	float inside = 0.0f;
+	float outside = pair.triangle1.bCircleRadius + pair.triangle2.bCircleRadius + 1.0f;
+
+	for (int i = 0; i < 24; ++i)
+	{
+		float middle = (inside + outside) * 0.5f;
+		Place(pair.triangle1, pair.triangle2, direction, middle);
+
+		if (CollisionChecks::Minkowski(pair.triangle1, pair.triangle2))
+			inside = middle;
+		else
+			outside = middle;
+	}
+
+	float factor = (s_random() % 2 == 0) ? 0.99f : 1.01f;
+	Place(pair.triangle1, pair.triangle2, direction, (inside + outside) * 0.5f * factor);
+	FinishPair(pair);
+	return pair;
+}
+
+static std::map<std::string, std::vector<Pair>> GenerateScenarios(void)
+{
+	std::map<std::string, std::vector<Pair>> scenarios;
+
+	for (int i = 0; i < PairCount; ++i)
+	{
+		scenarios["separated"].push_back(SeparatedPair());
+		scenarios["overlapping"].push_back(OverlappingPair());
+		scenarios["near-touching"].push_back(NearTouchingPair());
+		scenarios["mixed-random"].push_back(i % 2 == 0 ? SeparatedPair() : OverlappingPair());
+	}
+
+	// same 50/50 pairs, branch friendly order against random order
+	std::vector<Pair>& mixed = scenarios["mixed-random"];
+	std::shuffle(mixed.begin(), mixed.end(), s_random);
+
+	std::vector<Pair> sorted = mixed;
+	std::stable_partition(sorted.begin(), sorted.end(), [](const Pair& pair) { return !pair.overlapping; });
+	scenarios["mixed-sorted"] = sorted;
+
+	return scenarios;
+}
+
+/**
+ * Runs the kernel over all pairs until MinSeconds passed,
+ * after one untimed warm-up pass
+ */
+static Result Measure(const std::string& kernel, const std::string& scenario, const std::vector<Pair>& pairs, const std::function<bool(const Pair&)>& function)
+{
+	volatile unsigned int sink = 0;
+	unsigned int hits = 0;
+
+	for (size_t i = 0; i < pairs.size(); ++i)
+	{
+		hits += function(pairs[i]);
+	}
+
+	unsigned long long operations = 0;
+	unsigned long long allocationsBefore = s_allocations.load(std::memory_order_relaxed);
+	auto start = std::chrono::steady_clock::now();
+	double seconds = 0.0;
+
+	do
+	{
+		unsigned int passHits = 0;
+		for (size_t i = 0; i < pairs.size(); ++i)
+		{
+			passHits += function(pairs[i]);
+		}
+
+		sink = sink + passHits;
+		operations += pairs.size();
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	} while (seconds < MinSeconds);
+
+	unsigned long long allocations = s_allocations.load(std::memory_order_relaxed) - allocationsBefore;
+
+	Result result;
+	result.kernel = kernel;
+	result.scenario = scenario;
+	result.nsPerOp = seconds * 1e9 / operations;
+	result.allocsPerOp = static_cast<double>(allocations) / operations;
+	result.hitRatio = static_cast<double>(hits) / pairs.size();
+	return result;
+}
+
+static std::vector<Result> RunAll(void)
+{
+	std::map<std::string, std::vector<Pair>> scenarios = GenerateScenarios();
+
+	std::vector<std::pair<std::string, std::function<bool(const Pair&)>>> kernels;
+
+	kernels.push_back(std::make_pair("AABB", [](const Pair& pair) { return CollisionChecks::AABB(pair.triangle1, pair.triangle2); }));
+	kernels.push_back(std::make_pair("OOBB", [](const Pair& pair) { return CollisionChecks::OOBB(pair.triangle1, pair.triangle2); }));
+	kernels.push_back(std::make_pair("Minkowski", [](const Pair& pair) { return CollisionChecks::Minkowski(pair.triangle1, pair.triangle2); }));
+	kernels.push_back(std::make_pair("PointInConvexShape", [](const Pair& pair) { return CollisionChecks::PointInConvexShape(glm::vec2(0.0f, 0.0f), pair.minkowskiHull); }));
+	kernels.push_back(std::make_pair("GiftWrapping::OptimizedCalc", [](const Pair& pair)
+	{
+		// GiftWrapping keeps a reference to the points, the copy is part of the measured cost
+		std::vector<glm::vec2> points = pair.minkowskiPoints;
+		GiftWrapping convexHull(points);
+		convexHull.OptimizedCalc();
+
+		// no hit or miss here, the result only keeps the call alive
+		return convexHull.GetHull().size() > 1;
+	}));
+
+	std::vector<Result> results;
+
+	for (size_t k = 0; k < kernels.size(); ++k)
+	{
+		for (auto it = scenarios.begin(); it != scenarios.end(); ++it)
+		{
+			results.push_back(Measure(kernels[k].first, it->first, it->second, kernels[k].second));
+		}
+	}
+
+	return results;
+}
+
+static bool SaveBaseline(const std::string& file, const std::vector<Result>& results)
+{
+	std::ofstream out(file);
+	if (!out)
+		return false;
+
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		out << results[i].kernel << " " << results[i].scenario << " " << results[i].nsPerOp << " " << results[i].allocsPerOp << "\n";
+	}
+
+	return static_cast<bool>(out);
+}
+
+static bool LoadBaseline(const std::string& file, std::map<std::string, Result>& baseline)
+{
+	std::ifstream in(file);
+	if (!in)
+		return false;
+
+	std::string line;
+	while (std::getline(in, line))
+	{
+		std::istringstream values(line);
+
+		Result result;
+		if (values >> result.kernel >> result.scenario >> result.nsPerOp >> result.allocsPerOp)
+			baseline[result.kernel + " " + result.scenario] = result;
+	}
+
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	std::string saveFile;
+	std::string compareFile;
+	double threshold = 10.0;
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string option = argv[i];
+
+		if (option == "--save")
+			saveFile = argv[i + 1];
+		else if (option == "--compare")
+			compareFile = argv[i + 1];
+		else if (option == "--threshold")
+			threshold = std::atof(argv[i + 1]);
+	}
+
+	std::map<std::string, Result> baseline;
+	if (!compareFile.empty() && !LoadBaseline(compareFile, baseline))
+	{
+		std::printf("could not read baseline %s\n", compareFile.c_str());
+		return 2;
+	}
+
+	std::vector<Result> results = RunAll();
+	int regressions = 0;
+
+	std::printf("%-28s %-14s %10s %10s %6s", "kernel", "scenario", "ns/op", "allocs/op", "hits");
+	if (!baseline.empty())
+		std::printf(" %10s", "change");
+	std::printf("\n");
+
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const Result& result = results[i];
+		std::printf("%-28s %-14s %10.2f %10.2f %5.0f%%", result.kernel.c_str(), result.scenario.c_str(), result.nsPerOp, result.allocsPerOp, result.hitRatio * 100.0);
+
+		auto it = baseline.find(result.kernel + " " + result.scenario);
+		if (it != baseline.end())
+		{
+			double change = (result.nsPerOp / it->second.nsPerOp - 1.0) * 100.0;
+			bool regression = change > threshold || result.allocsPerOp > it->second.allocsPerOp + 0.01;
+
+			std::printf(" %+9.1f%%%s", change, regression ? "  REGRESSION" : "");
+			regressions += regression;
+		}
+
+		std::printf("\n");
+	}
+
+	if (!saveFile.empty() && !SaveBaseline(saveFile, results))
+	{
+		std::printf("could not write baseline %s\n", saveFile.c_str());
+		return 2;
+	}
+
+	if (!baseline.empty())
+		std::printf("%d regression(s) over %.1f%%\n", regressions, threshold);
+
+	return regressions > 0 ? 1 : 0;
+}
@@ -2,14 +2,33 @@
 
 #include "Triangle.h"
 #include "GiftWrapping.h"
+#include "DebugDraw.h"
+#include "Trace.h"
+
+CollisionStats& CollisionStats::Current(void)
+{
+	static CollisionStats stats = {};
+	return stats;
+}
+
+void CollisionStats::Reset(void)
+{
+	circleTests = 0;
+	aabbTests = 0;
+	obbTests = 0;
+	minkowskiTests = 0;
+	hits = 0;
+}
 
 bool CollisionChecks::AABB(const Triangle& triangle1, const Triangle& triangle2)
 {
-	float x = triangle1.position.x + triangle1.bCircleCenter.x - triangle1.aabbDimensions.x * 0.5f;
-	float y = triangle1.position.y + triangle1.bCircleCenter.y - triangle1.aabbDimensions.y * 0.5f;
+	TRACE_SCOPE("aabb");
 
-	float otherX = triangle2.position.x + triangle2.bCircleCenter.x - triangle2.aabbDimensions.x * 0.5f;
-	float otherY = triangle2.position.y + triangle2.bCircleCenter.y - triangle2.aabbDimensions.y * 0.5f;
+	float x = triangle1.position.x + triangle1.aabbCenter.x - triangle1.aabbDimensions.x * 0.5f;
+	float y = triangle1.position.y + triangle1.aabbCenter.y - triangle1.aabbDimensions.y * 0.5f;
+
+	float otherX = triangle2.position.x + triangle2.aabbCenter.x - triangle2.aabbDimensions.x * 0.5f;
+	float otherY = triangle2.position.y + triangle2.aabbCenter.y - triangle2.aabbDimensions.y * 0.5f;
 
 	if (x + triangle1.aabbDimensions.x < otherX || x > otherX + triangle2.aabbDimensions.x)
 		return false;
@@ -22,46 +41,38 @@ bool CollisionChecks::AABB(const Triangle& triangle1, const Triangle& triangle2)
 
 bool CollisionChecks::OOBB(const Triangle& triangle1, const Triangle& triangle2)
 {
+	TRACE_SCOPE("obb");
+
 	return OBBOverlap(triangle1, triangle2) && OBBOverlap(triangle2, triangle1);
 }
 
-bool CollisionChecks::Minkowski(const Triangle& triangle1, const Triangle& triangle2)
+/**
+ * Same cascade as Triangle::TestCollision up to the narrow phase, so the stage
+ * counters of different bounding volumes can be compared on the same pairs
+ */
+void CollisionChecks::CountStages(const Triangle& triangle1, const Triangle& triangle2, CollisionStats& stats)
 {
-	// create minkowski points by adding the negated triangle2 to each point of triangle1
-	std::vector<glm::vec2> minkowskiPoints;
-	minkowskiPoints.reserve(9);
+	++stats.circleTests;
 
-	glm::vec2 t1p0 = { triangle1.position + triangle1.relativeP0 };
-	glm::vec2 t1p1 = { triangle1.position + triangle1.relativeP1 };
-	glm::vec2 t1p2 = { triangle1.position + triangle1.relativeP2 };
+	float distance = glm::distance(triangle1.position + triangle1.bCircleCenter, triangle2.position + triangle2.bCircleCenter);
+	if (distance > triangle1.bCircleRadius + triangle2.bCircleRadius)
+		return;
 
-	glm::vec2 t2p0 = { triangle2.position + triangle2.relativeP0 };
-	glm::vec2 t2p1 = { triangle2.position + triangle2.relativeP1 };
-	glm::vec2 t2p2 = { triangle2.position + triangle2.relativeP2 };
-
-	minkowskiPoints.emplace_back(glm::vec2(t1p0.x - t2p0.x, t1p0.y - t2p0.y));
-	minkowskiPoints.emplace_back(glm::vec2(t1p0.x - t2p1.x, t1p0.y - t2p1.y));
-	minkowskiPoints.emplace_back(glm::vec2(t1p0.x - t2p2.x, t1p0.y - t2p2.y));
+	++stats.aabbTests;
+	if (!AABB(triangle1, triangle2))
+		return;
 
-	minkowskiPoints.emplace_back(glm::vec2(t1p1.x - t2p0.x, t1p1.y - t2p0.y));
-	minkowskiPoints.emplace_back(glm::vec2(t1p1.x - t2p1.x, t1p1.y - t2p1.y));
-	minkowskiPoints.emplace_back(glm::vec2(t1p1.x - t2p2.x, t1p1.y - t2p2.y));
-
-	minkowskiPoints.emplace_back(glm::vec2(t1p2.x - t2p0.x, t1p2.y - t2p0.y));
-	minkowskiPoints.emplace_back(glm::vec2(t1p2.x - t2p1.x, t1p2.y - t2p1.y));
-	minkowskiPoints.emplace_back(glm::vec2(t1p2.x - t2p2.x, t1p2.y - t2p2.y));
+	++stats.obbTests;
+	if (!OOBB(triangle1, triangle2))
+		return;
 
-	// create convex hull
-	GiftWrapping convexHull(minkowskiPoints);
-	convexHull.OptimizedCalc();
-	std::vector<glm::vec2> minkowskiShape = convexHull.GetHull();
-
-	// check if origin is inside minkowski shape
-	return PointInConvexShape(glm::vec2(0.0f, 0.0f), minkowskiShape);
+	++stats.minkowskiTests;
 }
 
-bool CollisionChecks::Minkowski(const Triangle & triangle1, const Triangle & triangle2, sf::RenderWindow & window)
+bool CollisionChecks::Minkowski(const Triangle& triangle1, const Triangle& triangle2)
 {
+	TRACE_SCOPE("minkowski");
+
 	// create minkowski points by adding the negated triangle2 to each point of triangle1
 	std::vector<glm::vec2> minkowskiPoints;
 	minkowskiPoints.reserve(9);
@@ -91,23 +102,18 @@ bool CollisionChecks::Minkowski(const Triangle & triangle1, const Triangle & tri
 	convexHull.OptimizedCalc();
 	std::vector<glm::vec2> minkowskiShape = convexHull.GetHull();
 
-	// draw OBB
-	sf::ConvexShape hull;
-	hull.setPointCount(minkowskiShape.size());
+	// check if origin is inside minkowski shape
+	bool collision = PointInConvexShape(glm::vec2(0.0f, 0.0f), minkowskiShape);
 
-	for (size_t i = 0; i < minkowskiShape.size(); ++i)
+	if (DebugDraw::IsEnabled())
 	{
-		hull.setPoint(i, { minkowskiShape[i].x, minkowskiShape[i].y });
-	}
-
-	hull.setFillColor(sf::Color::Transparent);
-	hull.setOutlineColor(sf::Color::Green);
-	hull.setOutlineThickness(1.0f);
+		DebugDraw::Hull(minkowskiShape, sf::Color::Green);
 
-	window.draw(hull);
+		if (collision)
+			RecordContact(triangle1, minkowskiShape);
+	}
 
-	// check if origin is inside minkowski shape
-	return PointInConvexShape(glm::vec2(0.0f, 0.0f), minkowskiShape);
+	return collision;
 }
 
 bool CollisionChecks::OBBOverlap(const Triangle& triangle1, const Triangle& triangle2)
@@ -198,3 +204,44 @@ bool CollisionChecks::PointInConvexShape(const glm::vec2& point, const std::vect
 
 	return true;
 }
+
+/**
+ * The edge of the minkowski shape closest to the origin gives the contact normal
+ * and the penetration depth, only evaluated while debug drawing is enabled
+ */
+void CollisionChecks::RecordContact(const Triangle& triangle1, const std::vector<glm::vec2>& minkowskiShape)
+{
+	// the hull repeats its first point at the end
+	float minDistance = 99999999;
+	glm::vec2 normal;
+
+	for (size_t i = 0; i + 1 < minkowskiShape.size(); ++i)
+	{
+		glm::vec2 edge = minkowskiShape[i + 1] - minkowskiShape[i];
+		if (edge.x == 0.0f && edge.y == 0.0f)
+			continue;
+
+		glm::vec2 edgeNormal = glm::normalize(glm::vec2(edge.y, -edge.x));
+		float distance = glm::dot(edgeNormal, minkowskiShape[i]);
+
+		// orientation independent, the origin is always on the inner side
+		if (distance < 0.0f)
+		{
+			distance = -distance;
+			edgeNormal = -edgeNormal;
+		}
+
+		if (distance < minDistance)
+		{
+			minDistance = distance;
+			normal = edgeNormal;
+		}
+	}
+
+	if (minDistance == 99999999)
+		return;
+
+	// triangle1 has to move against the normal to resolve the overlap
+	glm::vec2 start = triangle1.position + triangle1.bCircleCenter;
+	DebugDraw::Normal(start, start - normal * minDistance, sf::Color::Cyan);
+}
@@ -5,11 +5,6 @@
 
 struct Triangle;
 
-namespace sf
-{
-	class RenderWindow;
-}
-
 struct Side
 {
 	enum Enum {
@@ -19,18 +14,42 @@ struct Side
 	};
 };
 
+// indices of two intersecting objects
+struct CollisionPair
+{
+	int first;
+	int second;
+};
+
+// number of pairs that reached each stage of the check cascade
+struct CollisionStats
+{
+	unsigned int circleTests;
+	unsigned int aabbTests;
+	unsigned int obbTests;
+	unsigned int minkowskiTests;
+	unsigned int hits;
+
+	void Reset(void);
+
+	static CollisionStats& Current(void);
+};
+
 struct CollisionChecks
 {
 public:
 	static bool AABB(const Triangle& triangle1, const Triangle& triangle2);
 	static bool OOBB(const Triangle& triangle1, const Triangle& triangle2);
 	static bool Minkowski(const Triangle& triangle1, const Triangle& triangle2);
-	static bool Minkowski(const Triangle& triangle1, const Triangle& triangle2, sf::RenderWindow& window);
+	static bool PointInConvexShape(const glm::vec2& point, const std::vector<glm::vec2>& shape);
+
+	// counts the stages one pair reaches without running the narrow phase or touching its status
+	static void CountStages(const Triangle& triangle1, const Triangle& triangle2, CollisionStats& stats);
 
 private:
 	static bool OBBOverlap(const Triangle& triangle1, const Triangle& triangle2);
 	static void SATTest(const glm::vec2& axis, const std::vector<glm::vec2>& points, float& min, float& max);
 	static bool Overlaps(float min1, float max1, float min2, float max2);
 	static bool IsBetweenOrdered(float val, float lowerBound, float upperBound);
-	static bool PointInConvexShape(const glm::vec2& point, const std::vector<glm::vec2>& shape);
+	static void RecordContact(const Triangle& triangle1, const std::vector<glm::vec2>& minkowskiShape);
 };
@@ -0,0 +1,224 @@
+#include "CollisionIslands.h"
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+CollisionIslands::CollisionIslands(int sleepFrames)
+	: m_capacity(0)
+	, m_sleepFrames(sleepFrames)
+	, m_sleepingCount(0)
+{
+	m_islandOffsets.push_back(0);
+}
+
+void CollisionIslands::Build(int objectCount, const std::vector<CollisionPair>& pairs, ThreadPool* threadPool)
+{
+	Resize(objectCount);
+
+	for (int i = 0; i < objectCount; ++i)
+	{
+		m_parent[i].store(i, std::memory_order_relaxed);
+	}
+
+	// the union-find is lock-free, so the pairs can be split across threads freely
+	const int pairCount = static_cast<int>(pairs.size());
+	const int grainSize = 4096;
+
+	if (threadPool != nullptr && pairCount > grainSize)
+	{
+		threadPool->ParallelFor(pairCount, grainSize, [this, &pairs](int begin, int end) { UnionRange(pairs, begin, end); });
+	}
+	else
+	{
+		UnionRange(pairs, 0, pairCount);
+	}
+
+	// count the members of every root, only roots with at least two members form an island
+	std::vector<int> rootCount(objectCount, 0);
+	for (int i = 0; i < objectCount; ++i)
+	{
+		++rootCount[Find(i)];
+	}
+
+	// island index per root, ordered by root index
+	std::vector<int> rootIsland(objectCount, -1);
+	m_islandOffsets.clear();
+	m_islandOffsets.push_back(0);
+
+	for (int i = 0; i < objectCount; ++i)
+	{
+		if (rootCount[i] > 1)
+		{
+			rootIsland[i] = static_cast<int>(m_islandOffsets.size()) - 1;
+			m_islandOffsets.push_back(m_islandOffsets.back() + rootCount[i]);
+		}
+	}
+
+	m_islandMembers.resize(m_islandOffsets.back());
+	std::vector<int> fill(m_islandOffsets.begin(), m_islandOffsets.end() - 1);
+
+	for (int i = 0; i < objectCount; ++i)
+	{
+		int island = rootIsland[Find(i)];
+		m_objectIsland[i] = island;
+
+		if (island >= 0)
+			m_islandMembers[fill[island]++] = i;
+	}
+
+	// the rest time of an island is the one of its most recently moved member
+	for (int i = 0; i < objectCount; ++i)
+	{
+		if (m_restFrames[i] < m_sleepFrames)
+			++m_restFrames[i];
+	}
+
+	m_sleepingCount = 0;
+	for (int i = 0; i < objectCount; ++i)
+	{
+		if (m_objectIsland[i] < 0)
+		{
+			m_asleep[i] = m_restFrames[i] >= m_sleepFrames;
+			m_sleepingCount += m_asleep[i];
+		}
+	}
+
+	for (int island = 0; island < GetIslandCount(); ++island)
+	{
+		const int* members = GetIslandMembers(island);
+		const int size = GetIslandSize(island);
+
+		bool resting = true;
+		for (int k = 0; k < size && resting; ++k)
+		{
+			resting = m_restFrames[members[k]] >= m_sleepFrames;
+		}
+
+		for (int k = 0; k < size; ++k)
+		{
+			m_asleep[members[k]] = resting;
+		}
+
+		if (resting)
+			m_sleepingCount += size;
+	}
+
+	m_pairs = pairs;
+}
+
+void CollisionIslands::Wake(int object)
+{
+	if (object < static_cast<int>(m_restFrames.size()))
+		m_restFrames[object] = 0;
+}
+
+void CollisionIslands::WakeAll(void)
+{
+	std::fill(m_restFrames.begin(), m_restFrames.end(), 0);
+}
+
+void CollisionIslands::Detach(int object)
+{
+	if (object >= static_cast<int>(m_restFrames.size()))
+		return;
+
+	const int island = m_objectIsland[object];
+	if (island >= 0)
+	{
+		const int* members = GetIslandMembers(island);
+		for (int k = 0; k < GetIslandSize(island); ++k)
+		{
+			m_restFrames[members[k]] = 0;
+			m_asleep[members[k]] = 0;
+		}
+	}
+
+	m_restFrames[object] = 0;
+	m_asleep[object] = 0;
+}
+
+void CollisionIslands::Reset(void)
+{
+	m_islandOffsets.assign(1, 0);
+	m_islandMembers.clear();
+	m_objectIsland.clear();
+	m_restFrames.clear();
+	m_asleep.clear();
+	m_pairs.clear();
+	m_sleepingCount = 0;
+}
+
+void CollisionIslands::RetainSleepingPairs(std::vector<CollisionPair>& pairs) const
+{
+	for (size_t i = 0; i < m_pairs.size(); ++i)
+	{
+		if (IsAsleep(m_pairs[i].first) && IsAsleep(m_pairs[i].second))
+			pairs.push_back(m_pairs[i]);
+	}
+}
+
+void CollisionIslands::Resize(int objectCount)
+{
+	if (objectCount > m_capacity)
+	{
+		m_parent.reset(new std::atomic<int>[objectCount]);
+		m_capacity = objectCount;
+	}
+
+	// objects added since the last build start awake
+	m_restFrames.resize(objectCount, 0);
+	m_asleep.resize(objectCount, 0);
+	m_objectIsland.resize(objectCount, -1);
+}
+
+void CollisionIslands::UnionRange(const std::vector<CollisionPair>& pairs, int begin, int end)
+{
+	for (int i = begin; i < end; ++i)
+	{
+		Union(pairs[i].first, pairs[i].second);
+	}
+}
+
+/**
+ * Find with path halving, a failed CAS only means another thread
+ * already shortened the path
+ */
+int CollisionIslands::Find(int object)
+{
+	while (true)
+	{
+		int parent = m_parent[object].load(std::memory_order_acquire);
+		if (parent == object)
+			return object;
+
+		int grandParent = m_parent[parent].load(std::memory_order_acquire);
+		if (parent != grandParent)
+			m_parent[object].compare_exchange_weak(parent, grandParent, std::memory_order_acq_rel);
+
+		object = grandParent;
+	}
+}
+
+/**
+ * Always links the larger root below the smaller one, so no cycles can form.
+ * The CAS fails if the root got linked by another thread in the meantime.
+ */
+void CollisionIslands::Union(int a, int b)
+{
+	while (true)
+	{
+		a = Find(a);
+		b = Find(b);
+
+		if (a == b)
+			return;
+
+		if (a > b)
+			std::swap(a, b);
+
+		int expected = b;
+		if (m_parent[b].compare_exchange_strong(expected, a, std::memory_order_acq_rel))
+			return;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Collision.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+class ThreadPool;
+
+/**
+ * Groups objects that are connected through colliding pairs
+ * Islands are independent of each other and can be handed out as separate
+ * work units. Objects that have no pair do not form an island.
+ *
+ * Sleeping: an island goes to sleep once none of its members moved for a
+ * number of frames. Sleeping objects skip detection, their pairs of the
+ * last frame are carried over until something wakes them up again.
+ */
+class CollisionIslands
+{
+public:
+	explicit CollisionIslands(int sleepFrames = 30);
+
+	// pairs may contain duplicates and both orders of the same pair
+	void Build(int objectCount, const std::vector<CollisionPair>& pairs, ThreadPool* threadPool = nullptr);
+
+	int GetIslandCount(void) const { return static_cast<int>(m_islandOffsets.size()) - 1; }
+	int GetIslandSize(int island) const { return m_islandOffsets[island + 1] - m_islandOffsets[island]; }
+	const int* GetIslandMembers(int island) const { return m_islandMembers.data() + m_islandOffsets[island]; }
+
+	// island of the object or -1 if it has no pair
+	int GetIsland(int object) const { return m_objectIsland[object]; }
+
+	bool IsAsleep(int object) const { return object < static_cast<int>(m_asleep.size()) && m_asleep[object] != 0; }
+	int GetSleepingCount(void) const { return m_sleepingCount; }
+
+	// resets the rest time, takes effect with the next Build
+	void Wake(int object);
+	void WakeAll(void);
+
+	// the object was removed or its index reused, it and its island wake right away,
+	// so none of its old pairs is retained
+	void Detach(int object);
+
+	// forgets islands, pairs and sleep state, needed when the object indices change
+	void Reset(void);
+
+	// appends the pairs of the last Build between two sleeping objects
+	void RetainSleepingPairs(std::vector<CollisionPair>& pairs) const;
+
+private:
+	void Resize(int objectCount);
+	void UnionRange(const std::vector<CollisionPair>& pairs, int begin, int end);
+	int Find(int object);
+	void Union(int a, int b);
+
+	std::unique_ptr<std::atomic<int>[]> m_parent;
+	int m_capacity;
+
+	// compact island lists, members of island i are m_islandMembers[m_islandOffsets[i] .. m_islandOffsets[i + 1])
+	std::vector<int> m_islandOffsets;
+	std::vector<int> m_islandMembers;
+	std::vector<int> m_objectIsland;
+
+	int m_sleepFrames;
+	int m_sleepingCount;
+	std::vector<int> m_restFrames;
+	std::vector<unsigned char> m_asleep;
+	std::vector<CollisionPair> m_pairs;
+};
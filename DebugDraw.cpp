@@ -0,0 +1,188 @@
+#include "DebugDraw.h"
+
+#include <cmath>
+
+std::atomic<bool> DebugDraw::s_enabled(false);
+std::atomic<unsigned int> DebugDraw::s_frame(0);
+std::mutex DebugDraw::s_buffersMutex;
+std::vector<std::unique_ptr<DebugDraw::FrameBuffers>> DebugDraw::s_buffers;
+
+void DebugDraw::SetEnabled(bool enabled)
+{
+	s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void DebugDraw::Hull(const std::vector<glm::vec2>& points, sf::Color color)
+{
+	if (!IsEnabled() || points.empty())
+		return;
+
+	Push(DebugShape::Hull, color, points.data(), static_cast<unsigned int>(points.size()));
+}
+
+void DebugDraw::OBB(const glm::vec2& p0, const glm::vec2& p1, const glm::vec2& p2, const glm::vec2& p3, sf::Color color)
+{
+	if (!IsEnabled())
+		return;
+
+	glm::vec2 corners[4] = { p0, p1, p2, p3 };
+	Push(DebugShape::OBB, color, corners, 4);
+}
+
+void DebugDraw::AABB(const glm::vec2& min, const glm::vec2& max, sf::Color color)
+{
+	if (!IsEnabled())
+		return;
+
+	glm::vec2 corners[2] = { min, max };
+	Push(DebugShape::AABB, color, corners, 2);
+}
+
+void DebugDraw::Circle(const glm::vec2& center, float radius, sf::Color color)
+{
+	if (!IsEnabled())
+		return;
+
+	glm::vec2 data[2] = { center, glm::vec2(radius, 0.0f) };
+	Push(DebugShape::Circle, color, data, 2);
+}
+
+void DebugDraw::Normal(const glm::vec2& start, const glm::vec2& end, sf::Color color)
+{
+	if (!IsEnabled())
+		return;
+
+	glm::vec2 data[2] = { start, end };
+	Push(DebugShape::Normal, color, data, 2);
+}
+
+void DebugDraw::EndFrame(void)
+{
+	s_frame.fetch_add(1, std::memory_order_release);
+}
+
+/**
+ * Draws every primitive of the finished frame as a single line batch and
+ * clears that frame in the buffers of all threads. The buffers recording the
+ * current frame are not touched.
+ */
+void DebugDraw::Flush(sf::RenderWindow& window)
+{
+	const unsigned int finished = (s_frame.load(std::memory_order_acquire) - 1) & 1;
+
+	// threads registering during the flush must not move the list under us
+	std::vector<FrameBuffers*> buffers;
+	{
+		std::lock_guard<std::mutex> lock(s_buffersMutex);
+
+		for (size_t b = 0; b < s_buffers.size(); ++b)
+		{
+			buffers.push_back(s_buffers[b].get());
+		}
+	}
+
+	sf::VertexArray lines(sf::Lines);
+
+	auto addLine = [&lines](const glm::vec2& a, const glm::vec2& b, sf::Color color)
+	{
+		lines.append(sf::Vertex({ a.x, a.y }, color));
+		lines.append(sf::Vertex({ b.x, b.y }, color));
+	};
+
+	for (size_t b = 0; b < buffers.size(); ++b)
+	{
+		DebugDrawBuffer& buffer = buffers[b]->frames[finished];
+
+		for (size_t i = 0; i < buffer.primitives.size(); ++i)
+		{
+			const DebugPrimitive& primitive = buffer.primitives[i];
+			const glm::vec2* p = &buffer.points[primitive.firstPoint];
+
+			switch (primitive.shape)
+			{
+			case DebugShape::Hull:
+			case DebugShape::OBB:
+				for (unsigned int k = 0; k < primitive.pointCount; ++k)
+				{
+					addLine(p[k], p[(k + 1) % primitive.pointCount], primitive.color);
+				}
+				break;
+
+			case DebugShape::AABB:
+				addLine({ p[0].x, p[0].y }, { p[1].x, p[0].y }, primitive.color);
+				addLine({ p[1].x, p[0].y }, { p[1].x, p[1].y }, primitive.color);
+				addLine({ p[1].x, p[1].y }, { p[0].x, p[1].y }, primitive.color);
+				addLine({ p[0].x, p[1].y }, { p[0].x, p[0].y }, primitive.color);
+				break;
+
+			case DebugShape::Circle:
+			{
+				const int segments = 24;
+				const float step = 6.2831853f / segments;
+				glm::vec2 previous = p[0] + glm::vec2(p[1].x, 0.0f);
+
+				for (int k = 1; k <= segments; ++k)
+				{
+					glm::vec2 next = p[0] + glm::vec2(std::cos(k * step), std::sin(k * step)) * p[1].x;
+					addLine(previous, next, primitive.color);
+					previous = next;
+				}
+				break;
+			}
+
+			case DebugShape::Normal:
+				addLine(p[0], p[1], primitive.color);
+				break;
+			}
+		}
+
+		buffer.Clear();
+	}
+
+	if (lines.getVertexCount() > 0)
+		window.draw(lines);
+}
+
+void DebugDraw::Discard(void)
+{
+	std::lock_guard<std::mutex> lock(s_buffersMutex);
+
+	for (size_t b = 0; b < s_buffers.size(); ++b)
+	{
+		s_buffers[b]->frames[0].Clear();
+		s_buffers[b]->frames[1].Clear();
+	}
+}
+
+/**
+ * Every thread records into its own buffers, so recording needs no locking.
+ * The buffers are registered once on first use and stay alive for the
+ * lifetime of the program to be reused by the next flush.
+ */
+DebugDraw::FrameBuffers& DebugDraw::ThreadBuffers(void)
+{
+	thread_local FrameBuffers* buffers = nullptr;
+
+	if (buffers == nullptr)
+	{
+		std::lock_guard<std::mutex> lock(s_buffersMutex);
+		s_buffers.emplace_back(new FrameBuffers());
+		buffers = s_buffers.back().get();
+	}
+
+	return *buffers;
+}
+
+void DebugDraw::Push(DebugShape::Enum shape, sf::Color color, const glm::vec2* points, unsigned int count)
+{
+	DebugDrawBuffer& buffer = ThreadBuffers().frames[s_frame.load(std::memory_order_acquire) & 1];
+
+	DebugPrimitive primitive;
+	primitive.shape = shape;
+	primitive.color = color;
+	primitive.firstPoint = static_cast<unsigned int>(buffer.points.size());
+	primitive.pointCount = count;
+
+	buffer.points.insert(buffer.points.end(), points, points + count);
+	buffer.primitives.push_back(primitive);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct DebugShape
+{
+	enum Enum
+	{
+		Hull = 0,
+		OBB = 1,
+		AABB = 2,
+		Circle = 3,
+		Normal = 4
+	};
+};
+
+struct DebugPrimitive
+{
+	DebugShape::Enum shape;
+	sf::Color color;
+
+	// range inside the points of the owning buffer
+	// Hull/OBB: outline points, AABB: min and max, Circle: center and (radius, 0), Normal: start and end
+	unsigned int firstPoint;
+	unsigned int pointCount;
+};
+
+struct DebugDrawBuffer
+{
+	std::vector<DebugPrimitive> primitives;
+	std::vector<glm::vec2> points;
+
+	void Clear(void)
+	{
+		primitives.clear();
+		points.clear();
+	}
+};
+
+/**
+ * Command buffer for debug geometry
+ * Collision code records primitives into a buffer owned by the calling thread.
+ * Every thread has one buffer per frame parity, EndFrame switches recording to
+ * the other one, so the render thread can draw the finished frame while the
+ * collision of the next frame already records.
+ * Recording is a no-op while disabled, callers should check IsEnabled()
+ * before building any data they only need for debug output.
+ */
+class DebugDraw
+{
+public:
+	static void SetEnabled(bool enabled);
+	static bool IsEnabled(void) { return s_enabled.load(std::memory_order_relaxed); }
+
+	static void Hull(const std::vector<glm::vec2>& points, sf::Color color);
+	static void OBB(const glm::vec2& p0, const glm::vec2& p1, const glm::vec2& p2, const glm::vec2& p3, sf::Color color);
+	static void AABB(const glm::vec2& min, const glm::vec2& max, sf::Color color);
+	static void Circle(const glm::vec2& center, float radius, sf::Color color);
+	static void Normal(const glm::vec2& start, const glm::vec2& end, sf::Color color);
+
+	// once all recording of the frame is done, later primitives go to the next frame
+	static void EndFrame(void);
+	// draws and clears the last finished frame, must be done before the next EndFrame
+	static void Flush(sf::RenderWindow& window);
+	// must not run concurrently with recording threads
+	static void Discard(void);
+
+private:
+	// the recording and the finished frame of one thread
+	struct FrameBuffers
+	{
+		DebugDrawBuffer frames[2];
+	};
+
+	static FrameBuffers& ThreadBuffers(void);
+	static void Push(DebugShape::Enum shape, sf::Color color, const glm::vec2* points, unsigned int count);
+
+	static std::atomic<bool> s_enabled;
+	static std::atomic<unsigned int> s_frame;
+	static std::mutex s_buffersMutex;
+	static std::vector<std::unique_ptr<FrameBuffers>> s_buffers;
+};
@@ -0,0 +1,258 @@
+#include "HierarchicalGrid.h"
+
+#include "Triangle.h"
+
+#include <algorithm>
+#include <cmath>
+
+HierarchicalGrid::HierarchicalGrid(float minCellSize, int levelCount)
+	: m_maxOverlayOverhang(0.0f)
+{
+	m_levels.resize(levelCount);
+
+	float cellSize = minCellSize;
+	for (int i = 0; i < levelCount; ++i)
+	{
+		m_levels[i].cellSize = cellSize;
+		m_levels[i].invCellSize = 1.0f / cellSize;
+		m_levels[i].objectCount = 0;
+		m_levels[i].maxRadius = 0.0f;
+
+		cellSize *= 2.0f;
+	}
+}
+
+void HierarchicalGrid::Clear(void)
+{
+	for (size_t i = 0; i < m_levels.size(); ++i)
+	{
+		for (auto it = m_levels[i].cells.begin(); it != m_levels[i].cells.end(); ++it)
+		{
+			it->second.clear();
+		}
+
+		m_levels[i].objectCount = 0;
+		m_levels[i].maxRadius = 0.0f;
+	}
+
+	m_locations.clear();
+	m_maxOverlayOverhang = 0.0f;
+}
+
+void HierarchicalGrid::Build(const std::vector<Triangle>& triangles)
+{
+	Clear();
+
+	for (size_t i = 0; i < triangles.size(); ++i)
+	{
+		Insert(static_cast<int>(i), triangles[i]);
+	}
+
+	ReleaseEmptyCells();
+}
+
+void HierarchicalGrid::Build(const std::vector<Triangle>& triangles, const std::vector<int>& indices)
+{
+	Clear();
+
+	for (size_t i = 0; i < indices.size(); ++i)
+	{
+		Insert(indices[i], triangles[indices[i]]);
+	}
+
+	ReleaseEmptyCells();
+}
+
+void HierarchicalGrid::ReleaseEmptyCells(void)
+{
+	// cells nobody moved back into are released, the others keep their capacity
+	for (size_t i = 0; i < m_levels.size(); ++i)
+	{
+		for (auto it = m_levels[i].cells.begin(); it != m_levels[i].cells.end();)
+		{
+			if (it->second.empty())
+				it = m_levels[i].cells.erase(it);
+			else
+				++it;
+		}
+	}
+}
+
+void HierarchicalGrid::Insert(int index, const Triangle& triangle)
+{
+	const int l = LevelFor(triangle.bCircleRadius);
+	Level& level = m_levels[l];
+	const long long key = CellFor(level, triangle);
+
+	level.cells[key].push_back(index);
+	++level.objectCount;
+	level.maxRadius = std::max(level.maxRadius, triangle.bCircleRadius);
+	m_maxOverlayOverhang = std::max(m_maxOverlayOverhang, triangle.CalculateOverlayOverhang());
+
+	if (index >= static_cast<int>(m_locations.size()))
+		m_locations.resize(index + 1, { -1, 0 });
+
+	m_locations[index] = { l, key };
+}
+
+/**
+ * The cell vector keeps its capacity, maxRadius of the level
+ * is not lowered and stays a conservative reach until the next build
+ */
+void HierarchicalGrid::Remove(int index)
+{
+	if (index >= static_cast<int>(m_locations.size()) || m_locations[index].level < 0)
+		return;
+
+	Location& location = m_locations[index];
+	Level& level = m_levels[location.level];
+
+	// query results are sorted afterwards, so the order inside a cell does not matter
+	std::vector<int>& cell = level.cells[location.key];
+	auto it = std::find(cell.begin(), cell.end(), index);
+	if (it != cell.end())
+	{
+		*it = cell.back();
+		cell.pop_back();
+	}
+
+	--level.objectCount;
+	location.level = -1;
+}
+
+void HierarchicalGrid::Refit(const std::vector<Triangle>& triangles, const std::vector<int>& indices)
+{
+	for (size_t i = 0; i < indices.size(); ++i)
+	{
+		const int index = indices[i];
+		const Triangle& triangle = triangles[index];
+
+		// overlays turn with the triangle even if it stays in its cell
+		m_maxOverlayOverhang = std::max(m_maxOverlayOverhang, triangle.CalculateOverlayOverhang());
+
+		if (index >= static_cast<int>(m_locations.size()) || m_locations[index].level < 0)
+		{
+			Insert(index, triangle);
+			continue;
+		}
+
+		Location& location = m_locations[index];
+		Level& level = m_levels[location.level];
+		const long long key = CellFor(level, triangle);
+
+		if (key == location.key)
+			continue;
+
+		std::vector<int>& oldCell = level.cells[location.key];
+		auto it = std::find(oldCell.begin(), oldCell.end(), index);
+		if (it != oldCell.end())
+		{
+			*it = oldCell.back();
+			oldCell.pop_back();
+		}
+
+		level.cells[key].push_back(index);
+		location.key = key;
+	}
+}
+
+void HierarchicalGrid::Query(const glm::vec2& center, float radius, std::vector<int>& result) const
+{
+	QueryRect(center - glm::vec2(radius, radius), center + glm::vec2(radius, radius), result);
+}
+
+void HierarchicalGrid::Query(const Triangle& triangle, std::vector<int>& result) const
+{
+	Query(triangle.position + triangle.bCircleCenter, triangle.bCircleRadius, result);
+}
+
+/**
+ * Walks the levels from coarse to fine. On each level only the cells whose
+ * loose bounds touch the query rectangle are visited, or the occupied cells
+ * directly if there are fewer of them than cells in the query range.
+ */
+void HierarchicalGrid::QueryRect(const glm::vec2& min, const glm::vec2& max, std::vector<int>& result, float margin) const
+{
+	result.clear();
+
+	for (int l = static_cast<int>(m_levels.size()) - 1; l >= 0; --l)
+	{
+		const Level& level = m_levels[l];
+		if (level.objectCount == 0)
+			continue;
+
+		// no object on this level reaches further than maxRadius plus the margin from its center
+		float reach = level.maxRadius + margin;
+
+		// clamped before the conversion, the view can be zoomed out arbitrarily far,
+		// the limit keeps the width of the range inside an int as well
+		auto cell = [&level](float world)
+		{
+			const float limit = static_cast<float>(1 << 29);
+			return static_cast<int>(std::min(std::max(std::floor(world * level.invCellSize), -limit), limit));
+		};
+
+		int minX = cell(min.x - reach);
+		int maxX = cell(max.x + reach);
+		int minY = cell(min.y - reach);
+		int maxY = cell(max.y + reach);
+
+		long long rangeCells = static_cast<long long>(maxX - minX + 1) * (maxY - minY + 1);
+
+		if (rangeCells > static_cast<long long>(level.cells.size()))
+		{
+			for (auto it = level.cells.begin(); it != level.cells.end(); ++it)
+			{
+				int x = static_cast<int>(it->first >> 32);
+				int y = static_cast<int>(static_cast<unsigned int>(it->first));
+
+				if (x < minX || x > maxX || y < minY || y > maxY)
+					continue;
+
+				result.insert(result.end(), it->second.begin(), it->second.end());
+			}
+		}
+		else
+		{
+			for (int y = minY; y <= maxY; ++y)
+			{
+				for (int x = minX; x <= maxX; ++x)
+				{
+					auto it = level.cells.find(CellKey(x, y));
+					if (it != level.cells.end())
+						result.insert(result.end(), it->second.begin(), it->second.end());
+				}
+			}
+		}
+	}
+
+	std::sort(result.begin(), result.end());
+}
+
+int HierarchicalGrid::LevelFor(float radius) const
+{
+	float diameter = radius * 2.0f;
+
+	for (size_t i = 0; i < m_levels.size(); ++i)
+	{
+		if (diameter <= m_levels[i].cellSize)
+			return static_cast<int>(i);
+	}
+
+	// larger than the coarsest level, the query reach grows with maxRadius
+	return static_cast<int>(m_levels.size()) - 1;
+}
+
+long long HierarchicalGrid::CellFor(const Level& level, const Triangle& triangle) const
+{
+	glm::vec2 center = triangle.position + triangle.bCircleCenter;
+	int x = static_cast<int>(std::floor(center.x * level.invCellSize));
+	int y = static_cast<int>(std::floor(center.y * level.invCellSize));
+
+	return CellKey(x, y);
+}
+
+long long HierarchicalGrid::CellKey(int x, int y)
+{
+	return (static_cast<long long>(x) << 32) | static_cast<unsigned int>(y);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+struct Triangle;
+
+/**
+ * Loose multi-level grid for the broad phase
+ * Every level doubles the cell size of the previous one. A triangle is stored
+ * once, in the cell of its bounding circle center on the finest level whose
+ * cells are at least as large as the circle diameter, so it reaches at most
+ * half a cell out of its cell.
+ * Cell vectors stay allocated across rebuilds and refits, only cells that
+ * are still empty after a full build are released.
+ */
+class HierarchicalGrid
+{
+public:
+	explicit HierarchicalGrid(float minCellSize = 8.0f, int levelCount = 10);
+
+	void Clear(void);
+	void Build(const std::vector<Triangle>& triangles);
+	// only the given indices, the others stay out of the grid
+	void Build(const std::vector<Triangle>& triangles, const std::vector<int>& indices);
+	void Insert(int index, const Triangle& triangle);
+	void Remove(int index);
+
+	// moves the given triangles whose bounding circle center left its cell,
+	// their radius must not have changed since they were inserted
+	void Refit(const std::vector<Triangle>& triangles, const std::vector<int>& indices);
+
+	// fills result with the indices of all triangles that might overlap the given circle, in ascending order
+	void Query(const glm::vec2& center, float radius, std::vector<int>& result) const;
+	void Query(const Triangle& triangle, std::vector<int>& result) const;
+
+	// fills result with the indices of all triangles that might overlap the rectangle, in ascending order
+	// margin widens the reach of every triangle beyond its bounding circle
+	void QueryRect(const glm::vec2& min, const glm::vec2& max, std::vector<int>& result, float margin = 0.0f) const;
+
+	// largest distance a debug overlay reaches past the bounding circle of an inserted triangle
+	float GetMaxOverlayOverhang(void) const { return m_maxOverlayOverhang; }
+
+private:
+	struct Level
+	{
+		float cellSize;
+		float invCellSize;
+		int objectCount;
+		float maxRadius;
+		std::unordered_map<long long, std::vector<int>> cells;
+	};
+
+	// cell an object is stored in, level -1 if it is not in the grid
+	struct Location
+	{
+		int level;
+		long long key;
+	};
+
+	void ReleaseEmptyCells(void);
+	int LevelFor(float radius) const;
+	long long CellFor(const Level& level, const Triangle& triangle) const;
+	static long long CellKey(int x, int y);
+
+	std::vector<Level> m_levels;
+	std::vector<Location> m_locations;
+	float m_maxOverlayOverhang;
+};
@@ -0,0 +1,54 @@
+#include "StatsOverlay.h"
+#include <sstream>
+
+StatsOverlay::StatsOverlay(std::string fontFile)
+	: m_dirty(false)
+{
+	m_font.loadFromFile(fontFile);
+
+	m_text.setFont(m_font);
+	m_text.setFillColor(sf::Color(255, 64, 64, 255));
+	m_text.setCharacterSize(18);
+	m_text.setPosition(10, 44);
+}
+
+StatsOverlay::~StatsOverlay()
+{
+}
+
+void StatsOverlay::SetLine(const std::string& name, const std::string& value)
+{
+	for (size_t i = 0; i < m_names.size(); ++i)
+	{
+		if (m_names[i] == name)
+		{
+			if (m_values[i] != value)
+			{
+				m_values[i] = value;
+				m_dirty = true;
+			}
+			return;
+		}
+	}
+
+	m_names.push_back(name);
+	m_values.push_back(value);
+	m_dirty = true;
+}
+
+void StatsOverlay::Draw(sf::RenderWindow& window)
+{
+	if (m_dirty)
+	{
+		std::stringstream lines;
+		for (size_t i = 0; i < m_names.size(); ++i)
+		{
+			lines << m_names[i] << " " << m_values[i] << "\n";
+		}
+
+		m_text.setString(lines.str());
+		m_dirty = false;
+	}
+
+	window.draw(m_text);
+}
@@ -0,0 +1,28 @@
+#ifndef STATS_OVERLAY_H
+#define STATS_OVERLAY_H
+
+#include <SFML/Graphics.hpp>
+
+#include <string>
+#include <vector>
+
+class StatsOverlay
+{
+public:
+	StatsOverlay(std::string fontFile);
+	~StatsOverlay();
+
+	// adds the line on first use, lines keep the order they were first set in
+	void SetLine(const std::string& name, const std::string& value);
+	void Draw(sf::RenderWindow& window);
+
+private:
+	std::vector<std::string> m_names;
+	std::vector<std::string> m_values;
+	bool m_dirty;
+
+	sf::Text m_text;
+	sf::Font m_font;
+};
+
+#endif
@@ -0,0 +1,107 @@
+#include "ThreadPool.h"
+
+#include "Trace.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int workerCount)
+	: m_generation(0)
+	, m_busyWorkers(0)
+	, m_stop(false)
+	, m_job(nullptr)
+	, m_nextIndex(0)
+	, m_count(0)
+	, m_grainSize(1)
+{
+	m_workers.reserve(workerCount);
+	for (unsigned int i = 0; i < workerCount; ++i)
+	{
+		m_workers.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wakeCondition.notify_all();
+
+	for (size_t i = 0; i < m_workers.size(); ++i)
+	{
+		m_workers[i].join();
+	}
+}
+
+void ThreadPool::ParallelFor(int count, int grainSize, const std::function<void(int, int)>& job)
+{
+	if (count <= 0)
+		return;
+
+	grainSize = std::max(grainSize, 1);
+
+	// not worth waking anybody up
+	if (m_workers.empty() || count <= grainSize)
+	{
+		job(0, count);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_job = &job;
+		m_count = count;
+		m_grainSize = grainSize;
+		m_nextIndex.store(0, std::memory_order_relaxed);
+		m_busyWorkers = static_cast<unsigned int>(m_workers.size());
+		++m_generation;
+	}
+	m_wakeCondition.notify_all();
+
+	RunChunks();
+
+	// every worker has to see this generation before the job goes out of scope
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_doneCondition.wait(lock, [this] { return m_busyWorkers == 0; });
+	m_job = nullptr;
+}
+
+void ThreadPool::WorkerLoop(void)
+{
+	unsigned long long seenGeneration = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wakeCondition.wait(lock, [this, seenGeneration] { return m_stop || m_generation != seenGeneration; });
+
+			if (m_stop)
+				return;
+
+			seenGeneration = m_generation;
+		}
+
+		RunChunks();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (--m_busyWorkers == 0)
+				m_doneCondition.notify_one();
+		}
+	}
+}
+
+void ThreadPool::RunChunks(void)
+{
+	while (true)
+	{
+		int begin = m_nextIndex.fetch_add(m_grainSize, std::memory_order_relaxed);
+		if (begin >= m_count)
+			return;
+
+		TRACE_SCOPE("job");
+		(*m_job)(begin, std::min(begin + m_grainSize, m_count));
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads for data parallel loops
+ * ParallelFor blocks until every chunk ran, the calling thread takes chunks as well.
+ */
+class ThreadPool
+{
+public:
+	explicit ThreadPool(unsigned int workerCount = std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	unsigned int GetWorkerCount(void) const { return static_cast<unsigned int>(m_workers.size()); }
+
+	// runs job(begin, end) over [0, count) in chunks of grainSize items
+	void ParallelFor(int count, int grainSize, const std::function<void(int, int)>& job);
+
+private:
+	void WorkerLoop(void);
+	void RunChunks(void);
+
+	std::vector<std::thread> m_workers;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wakeCondition;
+	std::condition_variable m_doneCondition;
+	unsigned long long m_generation;
+	unsigned int m_busyWorkers;
+	bool m_stop;
+
+	const std::function<void(int, int)>* m_job;
+	std::atomic<int> m_nextIndex;
+	int m_count;
+	int m_grainSize;
+};
@@ -0,0 +1,205 @@
+#include "Trace.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+std::atomic<bool> Trace::s_enabled(false);
+std::atomic<unsigned int> Trace::s_frame(0);
+std::mutex Trace::s_ringsMutex;
+std::vector<std::unique_ptr<TraceRing>> Trace::s_rings;
+std::deque<Trace::FrameEvents> Trace::s_history;
+unsigned long long Trace::s_droppedTotal = 0;
+
+void Trace::SetEnabled(bool enabled)
+{
+	// makes sure the controlling thread gets the first ring
+	ThreadRing();
+
+	s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+long long Trace::Now(void)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace::BeginFrame(void)
+{
+	s_frame.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Trace::Record(const char* name, long long start, long long end)
+{
+	TraceRing& ring = ThreadRing();
+
+	unsigned long long head = ring.head.load(std::memory_order_relaxed);
+	if (head - ring.tail.load(std::memory_order_acquire) >= TraceRing::Capacity)
+	{
+		ring.dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	TraceEvent& event = ring.events[head & (TraceRing::Capacity - 1)];
+	event.name = name;
+	event.start = start;
+	event.end = end;
+	event.frame = GetFrame();
+
+	ring.head.store(head + 1, std::memory_order_release);
+}
+
+void Trace::Collect(void)
+{
+	FrameEvents collected;
+	collected.frame = GetFrame();
+	collected.collectTime = Now();
+	bool hasDropped = false;
+
+	{
+		std::lock_guard<std::mutex> lock(s_ringsMutex);
+
+		for (size_t r = 0; r < s_rings.size(); ++r)
+		{
+			TraceRing& ring = *s_rings[r];
+
+			unsigned long long tail = ring.tail.load(std::memory_order_relaxed);
+			unsigned long long head = ring.head.load(std::memory_order_acquire);
+
+			for (; tail != head; ++tail)
+			{
+				collected.events.push_back(ring.events[tail & (TraceRing::Capacity - 1)]);
+				collected.threadIds.push_back(ring.threadId);
+			}
+
+			ring.tail.store(tail, std::memory_order_release);
+
+			unsigned int dropped = ring.dropped.exchange(0, std::memory_order_relaxed);
+			collected.dropped.push_back(dropped);
+
+			if (dropped > 0)
+			{
+				s_droppedTotal += dropped;
+				hasDropped = true;
+			}
+		}
+	}
+
+	if (collected.events.empty() && !hasDropped)
+		return;
+
+	s_history.push_back(std::move(collected));
+
+	while (s_history.size() > HistoryFrames)
+	{
+		s_history.pop_front();
+	}
+}
+
+bool Trace::WriteChromeTrace(const std::string& file, unsigned int firstFrame, unsigned int lastFrame)
+{
+	bool hasEvents = false;
+	for (size_t f = 0; f < s_history.size() && !hasEvents; ++f)
+	{
+		for (size_t i = 0; i < s_history[f].events.size() && !hasEvents; ++i)
+		{
+			hasEvents = s_history[f].events[i].frame >= firstFrame && s_history[f].events[i].frame <= lastFrame;
+		}
+	}
+
+	if (!hasEvents)
+		return false;
+
+	std::ofstream out(file);
+	if (!out)
+		return false;
+
+	// timestamps are in microseconds
+	out << std::fixed << std::setprecision(3);
+
+	out << "{\"traceEvents\":[\n";
+
+	bool first = true;
+	int maxThreadId = -1;
+	std::vector<unsigned long long> droppedPerThread;
+
+	for (size_t f = 0; f < s_history.size(); ++f)
+	{
+		const FrameEvents& frameEvents = s_history[f];
+
+		// lost events show up as a counter track per thread, so gaps in the timeline are visible
+		if (frameEvents.frame >= firstFrame && frameEvents.frame <= lastFrame)
+		{
+			for (size_t t = 0; t < frameEvents.dropped.size(); ++t)
+			{
+				if (droppedPerThread.size() <= t)
+					droppedPerThread.resize(t + 1, 0);
+
+				droppedPerThread[t] += frameEvents.dropped[t];
+
+				if (droppedPerThread[t] == 0)
+					continue;
+
+				out << (first ? "" : ",\n")
+					<< "{\"name\":\"dropped events\",\"ph\":\"C\",\"pid\":1,\"tid\":" << t
+					<< ",\"ts\":" << frameEvents.collectTime / 1000.0
+					<< ",\"args\":{\"dropped\":" << droppedPerThread[t] << "}}";
+
+				first = false;
+				if (static_cast<int>(t) > maxThreadId)
+					maxThreadId = static_cast<int>(t);
+			}
+		}
+
+		for (size_t i = 0; i < frameEvents.events.size(); ++i)
+		{
+			const TraceEvent& event = frameEvents.events[i];
+			if (event.frame < firstFrame || event.frame > lastFrame)
+				continue;
+
+			out << (first ? "" : ",\n")
+				<< "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << frameEvents.threadIds[i]
+				<< ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << (event.end - event.start) / 1000.0
+				<< ",\"args\":{\"frame\":" << event.frame << "}}";
+
+			first = false;
+			if (frameEvents.threadIds[i] > maxThreadId)
+				maxThreadId = frameEvents.threadIds[i];
+		}
+	}
+
+	for (int t = 0; t <= maxThreadId; ++t)
+	{
+		std::string threadName = t == 0 ? "main" : "thread " + std::to_string(t);
+		if (t < static_cast<int>(droppedPerThread.size()) && droppedPerThread[t] > 0)
+			threadName += " (" + std::to_string(droppedPerThread[t]) + " events dropped)";
+
+		out << (first ? "" : ",\n")
+			<< "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t
+			<< ",\"args\":{\"name\":\"" << threadName << "\"}}";
+
+		first = false;
+	}
+
+	out << "\n]}\n";
+
+	return true;
+}
+
+/**
+ * Rings are registered on first use and never freed,
+ * the thread that enables tracing first gets id 0
+ */
+TraceRing& Trace::ThreadRing(void)
+{
+	thread_local TraceRing* ring = nullptr;
+
+	if (ring == nullptr)
+	{
+		std::lock_guard<std::mutex> lock(s_ringsMutex);
+		s_rings.emplace_back(new TraceRing(static_cast<int>(s_rings.size())));
+		ring = s_rings.back().get();
+	}
+
+	return *ring;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct TraceEvent
+{
+	// must point to a string literal, only the pointer is stored
+	const char* name;
+	long long start;
+	long long end;
+	unsigned int frame;
+};
+
+/**
+ * Single producer ring buffer, written by its owning thread and drained by Trace::Collect.
+ * Events are dropped instead of overwritten when the ring is full.
+ */
+struct TraceRing
+{
+	static const unsigned int Capacity = 1 << 15;
+
+	TraceEvent events[Capacity];
+	std::atomic<unsigned long long> head;
+	std::atomic<unsigned long long> tail;
+	std::atomic<unsigned int> dropped;
+	int threadId;
+
+	TraceRing(int id) : head(0), tail(0), dropped(0), threadId(id) {}
+};
+
+/**
+ * Timeline recording of scoped zones, exported as chrome trace json
+ * that can be opened in chrome://tracing or ui.perfetto.dev.
+ * Recording costs one relaxed load while disabled.
+ */
+class Trace
+{
+public:
+	static void SetEnabled(bool enabled);
+	static bool IsEnabled(void) { return s_enabled.load(std::memory_order_relaxed); }
+
+	// nanoseconds of a monotonic clock
+	static long long Now(void);
+
+	static void BeginFrame(void);
+	static unsigned int GetFrame(void) { return s_frame.load(std::memory_order_relaxed); }
+
+	static void Record(const char* name, long long start, long long end);
+
+	// moves the events of all threads into the frame history, call on the main thread at the end of a frame
+	static void Collect(void);
+
+	// events lost to full rings since the start
+	static unsigned long long GetDroppedCount(void) { return s_droppedTotal; }
+
+	// writes all collected events of the frame range, false if nothing was written
+	static bool WriteChromeTrace(const std::string& file, unsigned int firstFrame, unsigned int lastFrame);
+
+private:
+	struct FrameEvents
+	{
+		unsigned int frame;
+		std::vector<TraceEvent> events;
+		std::vector<int> threadIds;
+
+		// events lost per thread id since the previous collect
+		long long collectTime;
+		std::vector<unsigned int> dropped;
+	};
+
+	static TraceRing& ThreadRing(void);
+
+	static std::atomic<bool> s_enabled;
+	static std::atomic<unsigned int> s_frame;
+
+	static std::mutex s_ringsMutex;
+	static std::vector<std::unique_ptr<TraceRing>> s_rings;
+
+	// only touched by the collecting thread
+	static std::deque<FrameEvents> s_history;
+	static unsigned long long s_droppedTotal;
+	static const size_t HistoryFrames = 600;
+};
+
+class TraceScope
+{
+public:
+	explicit TraceScope(const char* name)
+		: m_name(name)
+		, m_start(Trace::IsEnabled() ? Trace::Now() : 0)
+	{
+	}
+
+	~TraceScope()
+	{
+		if (m_start != 0)
+			Trace::Record(m_name, m_start, Trace::Now());
+	}
+
+private:
+	const char* m_name;
+	long long m_start;
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
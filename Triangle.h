@@ -4,6 +4,7 @@
 #include <glm/gtx/norm.hpp>
 
 #include "Collision.h"
+#include "DebugDraw.h"
 
 struct CollisionStatus
 {
@@ -17,6 +18,17 @@ struct CollisionStatus
 	};
 };
 
+struct BoundsMode
+{
+	enum Enum
+	{
+		// centroid circle and longest edge OBB, cheap to compute
+		Fast = 0,
+		// minimal enclosing circle and minimum-area OBB
+		Tight = 1
+	};
+};
+
 struct Triangle {
 	// world pos of the triangle
 	glm::vec2 position;
@@ -26,11 +38,27 @@ struct Triangle {
 	glm::vec2 relativeP1;
 	glm::vec2 relativeP2;
 
+	// rotation in radians with cached sin and cos
+	float rotation;
+	float cosRotation;
+	float sinRotation;
+
+	// unrotated points and bounds, the relativ ones are derived from these
+	glm::vec2 localP0;
+	glm::vec2 localP1;
+	glm::vec2 localP2;
+	glm::vec2 localCircleCenter;
+	glm::vec2 localObbP0;
+	glm::vec2 localObbP1;
+	glm::vec2 localObbP2;
+	glm::vec2 localObbP3;
+
 	// circumcenter, relativ to position
 	glm::vec2 bCircleCenter;
 	float bCircleRadius;
 
-	// width and height of AABB
+	// center, relativ to position, and width and height of AABB
+	glm::vec2 aabbCenter;
 	glm::vec2 aabbDimensions;
 
 	// OBB
@@ -57,39 +85,217 @@ struct Triangle {
 		return !(lhs == rhs);
 	}
 
-	static Triangle GenerateRandom(glm::vec2 size, glm::vec2 position)
+	static Triangle GenerateRandom(glm::vec2 size, glm::vec2 position, BoundsMode::Enum boundsMode = BoundsMode::Fast)
 	{
 		Triangle triangle;
 
 		float min = 5.0f;
 
 		float randX = rand() % static_cast<int>(size.x * 0.5f - min + 1) + min;
-		triangle.relativeP0 = { -randX, 0.0f };
+		triangle.localP0 = { -randX, 0.0f };
 
 		float randY = rand() % static_cast<int>(size.y * 0.5f - min + 1) + min;
-		triangle.relativeP1 = { 0.0f, randY };
+		triangle.localP1 = { 0.0f, randY };
 
 		float randX2 = rand() % static_cast<int>(size.x * 0.5f - min + 1) + min;
 		float randY2 = rand() % static_cast<int>(size.y * 0.5f - min + 1) + min;
-		triangle.relativeP2 = { randX, -randY };
+		triangle.localP2 = { randX, -randY };
 
 		triangle.position = position;
+		triangle.rotation = 0.0f;
+		triangle.cosRotation = 1.0f;
+		triangle.sinRotation = 0.0f;
 
-		triangle.CalculateCircumcenter();
-		triangle.CalculateAABB();
-		triangle.CalculateOBB();
+		triangle.CalculateBounds(boundsMode);
 
 		triangle.collisionStatus = CollisionStatus::None;
 
 		return triangle;
 	}
 
+	/**
+	 * Full bounds calculation on the unrotated points,
+	 * the current rotation is applied afterwards
+	 */
+	void CalculateBounds(BoundsMode::Enum boundsMode)
+	{
+		relativeP0 = localP0;
+		relativeP1 = localP1;
+		relativeP2 = localP2;
+
+		if (boundsMode == BoundsMode::Tight)
+		{
+			CalculateMinimalCircle();
+			CalculateMinAreaOBB();
+		}
+		else
+		{
+			CalculateCircumcenter();
+			CalculateOBB();
+		}
+
+		localCircleCenter = bCircleCenter;
+		localObbP0 = obbP0;
+		localObbP1 = obbP1;
+		localObbP2 = obbP2;
+		localObbP3 = obbP3;
+
+		ApplyRotation();
+	}
+
+	void SetRotation(float angle)
+	{
+		rotation = angle;
+		cosRotation = std::cos(angle);
+		sinRotation = std::sin(angle);
+
+		ApplyRotation();
+	}
+
+	/**
+	 * Incremental refit: the points, the circle center and the OBB are rotated,
+	 * the circle radius is rotation invariant and the AABB is refit from the rotated points
+	 */
+	void ApplyRotation(void)
+	{
+		const float c = cosRotation;
+		const float s = sinRotation;
+
+		auto rotate = [c, s](const glm::vec2& p) { return glm::vec2(c * p.x - s * p.y, s * p.x + c * p.y); };
+
+		relativeP0 = rotate(localP0);
+		relativeP1 = rotate(localP1);
+		relativeP2 = rotate(localP2);
+
+		bCircleCenter = rotate(localCircleCenter);
+
+		obbP0 = rotate(localObbP0);
+		obbP1 = rotate(localObbP1);
+		obbP2 = rotate(localObbP2);
+		obbP3 = rotate(localObbP3);
+
+		CalculateAABB();
+	}
+
+	/**
+	 * Batch version of SetRotation for all moved triangles, rotations[i] belongs to triangles[indices[i]].
+	 * The unrotated points, circle center and OBB corners are gathered into structure-of-arrays
+	 * scratch buffers, rotated and refit there in flat loops without any per-object calls,
+	 * which the compiler can vectorize, and scattered back afterwards.
+	 */
+	static void SetRotations(std::vector<Triangle>& triangles, const std::vector<int>& indices, const std::vector<float>& rotations)
+	{
+		// 0-2 triangle points, 3 circle center, 4-7 OBB corners
+		const int PointCount = 8;
+
+		static thread_local std::vector<float> cosines;
+		static thread_local std::vector<float> sines;
+		static thread_local std::vector<float> x[PointCount];
+		static thread_local std::vector<float> y[PointCount];
+		static thread_local std::vector<float> minX, maxX, minY, maxY;
+
+		const size_t count = indices.size();
+		cosines.resize(count);
+		sines.resize(count);
+		minX.resize(count);
+		maxX.resize(count);
+		minY.resize(count);
+		maxY.resize(count);
+
+		for (int k = 0; k < PointCount; ++k)
+		{
+			x[k].resize(count);
+			y[k].resize(count);
+		}
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			const Triangle& triangle = triangles[indices[i]];
+			const glm::vec2* local[PointCount] = {
+				&triangle.localP0, &triangle.localP1, &triangle.localP2, &triangle.localCircleCenter,
+				&triangle.localObbP0, &triangle.localObbP1, &triangle.localObbP2, &triangle.localObbP3
+			};
+
+			for (int k = 0; k < PointCount; ++k)
+			{
+				x[k][i] = local[k]->x;
+				y[k][i] = local[k]->y;
+			}
+
+			cosines[i] = std::cos(rotations[i]);
+			sines[i] = std::sin(rotations[i]);
+		}
+
+		// rotation in place, one pass per point
+		for (int k = 0; k < PointCount; ++k)
+		{
+			float* px = x[k].data();
+			float* py = y[k].data();
+			const float* c = cosines.data();
+			const float* s = sines.data();
+
+			for (size_t i = 0; i < count; ++i)
+			{
+				float rx = c[i] * px[i] - s[i] * py[i];
+				float ry = s[i] * px[i] + c[i] * py[i];
+				px[i] = rx;
+				py[i] = ry;
+			}
+		}
+
+		// AABB refit from the rotated triangle points
+		for (size_t i = 0; i < count; ++i)
+		{
+			minX[i] = std::min(x[0][i], std::min(x[1][i], x[2][i]));
+			maxX[i] = std::max(x[0][i], std::max(x[1][i], x[2][i]));
+			minY[i] = std::min(y[0][i], std::min(y[1][i], y[2][i]));
+			maxY[i] = std::max(y[0][i], std::max(y[1][i], y[2][i]));
+		}
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			Triangle& triangle = triangles[indices[i]];
+			glm::vec2* rotated[PointCount] = {
+				&triangle.relativeP0, &triangle.relativeP1, &triangle.relativeP2, &triangle.bCircleCenter,
+				&triangle.obbP0, &triangle.obbP1, &triangle.obbP2, &triangle.obbP3
+			};
+
+			for (int k = 0; k < PointCount; ++k)
+			{
+				rotated[k]->x = x[k][i];
+				rotated[k]->y = y[k][i];
+			}
+
+			triangle.rotation = rotations[i];
+			triangle.cosRotation = cosines[i];
+			triangle.sinRotation = sines[i];
+
+			triangle.aabbCenter = { (minX[i] + maxX[i]) * 0.5f, (minY[i] + maxY[i]) * 0.5f };
+			triangle.aabbDimensions = { maxX[i] - minX[i], maxY[i] - minY[i] };
+		}
+	}
+
 	void CalculateCircumcenter(void)
 	{
 		bCircleCenter = (relativeP0 + relativeP1 + relativeP2) / 3.0f;
 		bCircleRadius = std::max(glm::distance(bCircleCenter, relativeP0), std::max(glm::distance(bCircleCenter, relativeP1), glm::distance(bCircleCenter, relativeP2)));
 	}
 
+	// how far the AABB and OBB overlays reach past the square around the bounding circle
+	float CalculateOverlayOverhang(void) const
+	{
+		glm::vec2 circleMin = bCircleCenter - glm::vec2(bCircleRadius, bCircleRadius);
+		glm::vec2 circleMax = bCircleCenter + glm::vec2(bCircleRadius, bCircleRadius);
+
+		glm::vec2 overlayMin = glm::min(aabbCenter - aabbDimensions * 0.5f, glm::min(glm::min(obbP0, obbP1), glm::min(obbP2, obbP3)));
+		glm::vec2 overlayMax = glm::max(aabbCenter + aabbDimensions * 0.5f, glm::max(glm::max(obbP0, obbP1), glm::max(obbP2, obbP3)));
+
+		glm::vec2 below = circleMin - overlayMin;
+		glm::vec2 above = overlayMax - circleMax;
+
+		return std::max(0.0f, std::max(std::max(below.x, below.y), std::max(above.x, above.y)));
+	}
+
 	void CalculateAABB(void)
 	{
 		float minX = std::min(relativeP0.x, std::min(relativeP1.x, relativeP2.x));
@@ -98,9 +304,101 @@ struct Triangle {
 		float minY = std::min(relativeP0.y, std::min(relativeP1.y, relativeP2.y));
 		float maxY = std::max(relativeP0.y, std::max(relativeP1.y, relativeP2.y));
 
+		aabbCenter = { (minX + maxX) * 0.5f, (minY + maxY) * 0.5f };
 		aabbDimensions = { maxX - minX, maxY - minY };
 	}
 
+	/**
+	 * Smallest circle containing all three points
+	 * For right and obtuse triangles it is spanned by the longest edge,
+	 * otherwise it is the circumcircle
+	 */
+	void CalculateMinimalCircle(void)
+	{
+		const glm::vec2* points[3] = { &relativeP0, &relativeP1, &relativeP2 };
+
+		for (int i = 0; i < 3; ++i)
+		{
+			const glm::vec2& a = *points[i];
+			const glm::vec2& b = *points[(i + 1) % 3];
+			const glm::vec2& c = *points[(i + 2) % 3];
+
+			// angle at c is not acute, ab is the diameter
+			if (glm::dot(a - c, b - c) <= 0.0f)
+			{
+				bCircleCenter = (a + b) * 0.5f;
+				bCircleRadius = glm::distance(a, b) * 0.5f;
+				return;
+			}
+		}
+
+		glm::vec2 b = relativeP1 - relativeP0;
+		glm::vec2 c = relativeP2 - relativeP0;
+		float d = 2.0f * (b.x * c.y - b.y * c.x);
+
+		glm::vec2 center(
+			(c.y * glm::length2(b) - b.y * glm::length2(c)) / d,
+			(b.x * glm::length2(c) - c.x * glm::length2(b)) / d
+		);
+
+		bCircleCenter = relativeP0 + center;
+		bCircleRadius = std::max(glm::distance(bCircleCenter, relativeP0), std::max(glm::distance(bCircleCenter, relativeP1), glm::distance(bCircleCenter, relativeP2)));
+	}
+
+	/**
+	 * Rotating calipers: the minimum-area rectangle has one side collinear
+	 * with a hull edge, so every edge of the triangle is tried as base.
+	 * Equal areas are resolved by the smaller perimeter.
+	 */
+	void CalculateMinAreaOBB(void)
+	{
+		const glm::vec2 points[3] = { relativeP0, relativeP1, relativeP2 };
+
+		float bestArea = 99999999;
+		float bestPerimeter = 99999999;
+
+		for (int i = 0; i < 3; ++i)
+		{
+			glm::vec2 base = points[i];
+			glm::vec2 edge = points[(i + 1) % 3] - base;
+			float edgeLength = glm::length(edge);
+			if (edgeLength == 0.0f)
+				continue;
+
+			glm::vec2 axis = edge / edgeLength;
+			glm::vec2 normal(-axis.y, axis.x);
+
+			// extent along the edge, the opposite point may project outside of it
+			glm::vec2 opposite = points[(i + 2) % 3] - base;
+			float along = glm::dot(opposite, axis);
+			float minAlong = std::min(0.0f, along);
+			float maxAlong = std::max(edgeLength, along);
+			float height = glm::dot(opposite, normal);
+
+			// the opposite point decides which side of the edge the box is on
+			if (height < 0.0f)
+			{
+				height = -height;
+				normal = -normal;
+			}
+
+			float width = maxAlong - minAlong;
+			float area = width * height;
+			float perimeter = width + height;
+
+			if (area < bestArea * 0.9999f || (area <= bestArea * 1.0001f && perimeter < bestPerimeter))
+			{
+				bestArea = area;
+				bestPerimeter = perimeter;
+
+				obbP0 = base + axis * minAlong;
+				obbP1 = base + axis * maxAlong;
+				obbP2 = obbP1 + normal * height;
+				obbP3 = obbP0 + normal * height;
+			}
+		}
+	}
+
 	void CalculateOBB(void)
 	{
 		glm::vec2 A = relativeP0 - relativeP1;
@@ -151,105 +449,120 @@ struct Triangle {
 		return std::abs((Q.y - P.y)*X.x - (Q.x - P.x)*X.y + Q.x*P.y - Q.y*P.x) / std::sqrt(std::pow((Q.y - P.y), 2) + std::pow((Q.x - P.x), 2));
 	}
 
-	void CalculateCollision(std::vector<Triangle>& otherTriangles, sf::RenderWindow& window)
+	void CalculateCollision(std::vector<Triangle>& otherTriangles)
 	{
 		collisionStatus = CollisionStatus::None;
 
 		for (size_t i = 0; i < otherTriangles.size(); ++i)
 		{
-			Triangle& other = otherTriangles[i];
-			if (*this == other)
-				continue;
+			TestCollision(otherTriangles[i]);
+		}
+	}
 
-			// Circle - Circle Collision
-			float distance = glm::distance(position + bCircleCenter, other.position + other.bCircleCenter);
-			bool circleCollision = distance <= (bCircleRadius + other.bCircleRadius);
+	// only tests against the given indices, e.g. the result of a broad phase query
+	void CalculateCollision(std::vector<Triangle>& otherTriangles, const std::vector<int>& candidates)
+	{
+		collisionStatus = CollisionStatus::None;
 
-			if (!circleCollision)
-			{
-				continue;
-			}
+		for (size_t i = 0; i < candidates.size(); ++i)
+		{
+			TestCollision(otherTriangles[candidates[i]]);
+		}
+	}
 
-			// AABB Collision
-			if (!CollisionChecks::AABB(*this, other))
-			{
-				if (collisionStatus < CollisionStatus::Circle) collisionStatus = CollisionStatus::Circle;
-				if (other.collisionStatus < CollisionStatus::Circle) other.collisionStatus = CollisionStatus::Circle;
-				continue;
-			}
+	// same as above, every intersecting pair is reported as (selfIndex, candidate)
+	void CalculateCollision(std::vector<Triangle>& otherTriangles, const std::vector<int>& candidates, int selfIndex, std::vector<CollisionPair>& pairs)
+	{
+		collisionStatus = CollisionStatus::None;
 
-			// OBB Collision
-			if (!CollisionChecks::OOBB(*this, other))
-			{
-				if (collisionStatus < CollisionStatus::AABB) collisionStatus = CollisionStatus::AABB;
-				if (other.collisionStatus < CollisionStatus::AABB) other.collisionStatus = CollisionStatus::AABB;
-				continue;
-			}
+		for (size_t i = 0; i < candidates.size(); ++i)
+		{
+			if (TestCollision(otherTriangles[candidates[i]]))
+				pairs.push_back({ selfIndex, candidates[i] });
+		}
+	}
 
-			collisionStatus = CollisionStatus::OBB;
-			other.collisionStatus = CollisionStatus::OBB;
+	// runs the check cascade for one pair and updates both status, true if the triangles intersect
+	bool TestCollision(Triangle& other)
+	{
+		if (*this == other)
+			return false;
 
-			// Minkowski
-			if (!CollisionChecks::Minkowski(*this, other, window))
-			{
-				if (collisionStatus < CollisionStatus::OBB) collisionStatus = CollisionStatus::OBB;
-				if (other.collisionStatus < CollisionStatus::OBB) other.collisionStatus = CollisionStatus::OBB;
-				continue;
-			}
+		CollisionStats& stats = CollisionStats::Current();
+		++stats.circleTests;
+
+		// Circle - Circle Collision
+		float distance = glm::distance(position + bCircleCenter, other.position + other.bCircleCenter);
+		bool circleCollision = distance <= (bCircleRadius + other.bCircleRadius);
+
+		if (!circleCollision)
+		{
+			if (DebugDraw::IsEnabled()) RecordDebugVolumes(other, CollisionStatus::Circle);
+			return false;
+		}
 
-			collisionStatus = CollisionStatus::Minkowski;
-			other.collisionStatus = CollisionStatus::Minkowski;
+		// AABB Collision
+		++stats.aabbTests;
+		if (!CollisionChecks::AABB(*this, other))
+		{
+			if (DebugDraw::IsEnabled()) RecordDebugVolumes(other, CollisionStatus::AABB);
+			if (collisionStatus < CollisionStatus::Circle) collisionStatus = CollisionStatus::Circle;
+			if (other.collisionStatus < CollisionStatus::Circle) other.collisionStatus = CollisionStatus::Circle;
+			return false;
+		}
+
+		// OBB Collision
+		++stats.obbTests;
+		if (!CollisionChecks::OOBB(*this, other))
+		{
+			if (DebugDraw::IsEnabled()) RecordDebugVolumes(other, CollisionStatus::OBB);
+			if (collisionStatus < CollisionStatus::AABB) collisionStatus = CollisionStatus::AABB;
+			if (other.collisionStatus < CollisionStatus::AABB) other.collisionStatus = CollisionStatus::AABB;
+			return false;
 		}
+
+		collisionStatus = CollisionStatus::OBB;
+		other.collisionStatus = CollisionStatus::OBB;
+
+		// Minkowski
+		++stats.minkowskiTests;
+		if (!CollisionChecks::Minkowski(*this, other))
+		{
+			if (collisionStatus < CollisionStatus::OBB) collisionStatus = CollisionStatus::OBB;
+			if (other.collisionStatus < CollisionStatus::OBB) other.collisionStatus = CollisionStatus::OBB;
+			return false;
+		}
+
+		collisionStatus = CollisionStatus::Minkowski;
+		other.collisionStatus = CollisionStatus::Minkowski;
+		++stats.hits;
+
+		return true;
 	}
 
-	void CalculateCollision(std::vector<Triangle>& otherTriangles)
+	// records the bounding volumes of both triangles that the given stage rejected
+	void RecordDebugVolumes(const Triangle& other, CollisionStatus::Enum stage) const
 	{
-		collisionStatus = CollisionStatus::None;
+		const Triangle* triangles[2] = { this, &other };
 
-		for (size_t i = 0; i < otherTriangles.size(); ++i)
+		for (int i = 0; i < 2; ++i)
 		{
-			Triangle& other = otherTriangles[i];
-			if (*this == other)
-				continue;
-			
-			// Circle - Circle Collision
-			float distance = glm::distance(position + bCircleCenter, other.position + other.bCircleCenter);
-			bool circleCollision = distance <= (bCircleRadius + other.bCircleRadius);
+			const Triangle& triangle = *triangles[i];
+			const glm::vec2& p = triangle.position;
 
-			if (!circleCollision)
+			if (stage == CollisionStatus::Circle)
 			{
-				continue;
+				DebugDraw::Circle(p + triangle.bCircleCenter, triangle.bCircleRadius, sf::Color(242, 170, 107));
 			}
-
-			// AABB Collision
-			if (!CollisionChecks::AABB(*this, other))
+			else if (stage == CollisionStatus::AABB)
 			{
-				if (collisionStatus < CollisionStatus::Circle) collisionStatus = CollisionStatus::Circle;
-				if (other.collisionStatus < CollisionStatus::Circle) other.collisionStatus = CollisionStatus::Circle;
-				continue;
+				glm::vec2 halfDimensions = triangle.aabbDimensions * 0.5f;
+				DebugDraw::AABB(p + triangle.aabbCenter - halfDimensions, p + triangle.aabbCenter + halfDimensions, sf::Color(242, 92, 5));
 			}
-
-			// OBB Collision
-			if (!CollisionChecks::OOBB(*this, other))
+			else if (stage == CollisionStatus::OBB)
 			{
-				if (collisionStatus < CollisionStatus::AABB) collisionStatus = CollisionStatus::AABB;
-				if (other.collisionStatus < CollisionStatus::AABB) other.collisionStatus = CollisionStatus::AABB;
-				continue;
+				DebugDraw::OBB(p + triangle.obbP0, p + triangle.obbP1, p + triangle.obbP2, p + triangle.obbP3, sf::Color(242, 68, 5));
 			}
-
-			collisionStatus = CollisionStatus::OBB;
-			other.collisionStatus = CollisionStatus::OBB;
-
-			// Minkowski
-			if (!CollisionChecks::Minkowski(*this, other))
-			{
-				if (collisionStatus < CollisionStatus::OBB) collisionStatus = CollisionStatus::OBB;
-				if (other.collisionStatus < CollisionStatus::OBB) other.collisionStatus = CollisionStatus::OBB;
-				continue;
-			}
-
-			collisionStatus = CollisionStatus::Minkowski;
-			other.collisionStatus = CollisionStatus::Minkowski;
 		}
 	}
 
@@ -300,7 +613,7 @@ struct Triangle {
 			aabb.setOutlineThickness(-1.0f);
 
 			aabb.setOrigin(aabbDimensions.x * 0.5f, aabbDimensions.y * 0.5f);
-			aabb.setPosition(position.x + bCircleCenter.x, position.y + bCircleCenter.y);
+			aabb.setPosition(position.x + aabbCenter.x, position.y + aabbCenter.y);
 
 			window.draw(aabb);
 		}
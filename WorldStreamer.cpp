@@ -0,0 +1,384 @@
+#include "WorldStreamer.h"
+
+#include "Trace.h"
+
+#include <algorithm>
+#include <cmath>
+
+WorldStreamer::WorldStreamer(const std::string& worldFile, size_t memoryCap)
+	: m_open(false)
+	, m_tileSize(1.0f)
+	, m_originX(0.0f)
+	, m_originY(0.0f)
+	, m_tilesX(0)
+	, m_tilesY(0)
+	, m_worldFile(worldFile)
+	, m_memoryCap(memoryCap)
+	, m_boundsMode(BoundsMode::Fast)
+	, m_updateCount(0)
+	, m_residentTriangles(0)
+	, m_stop(false)
+{
+	std::ifstream file(worldFile, std::ios::binary);
+	if (!file)
+		return;
+
+	file.read(reinterpret_cast<char*>(&m_tileSize), sizeof(float));
+	file.read(reinterpret_cast<char*>(&m_originX), sizeof(float));
+	file.read(reinterpret_cast<char*>(&m_originY), sizeof(float));
+	file.read(reinterpret_cast<char*>(&m_tilesX), sizeof(int));
+	file.read(reinterpret_cast<char*>(&m_tilesY), sizeof(int));
+
+	if (!file || m_tilesX <= 0 || m_tilesY <= 0 || m_tileSize <= 0.0f)
+		return;
+
+	m_tiles.resize(m_tilesX * m_tilesY);
+	file.read(reinterpret_cast<char*>(m_tiles.data()), m_tiles.size() * sizeof(TileEntry));
+
+	if (!file)
+		return;
+
+	m_open = true;
+	m_ioThread = std::thread(&WorldStreamer::IOLoop, this);
+}
+
+WorldStreamer::~WorldStreamer()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_requestCondition.notify_one();
+
+	if (m_ioThread.joinable())
+		m_ioThread.join();
+}
+
+bool WorldStreamer::GenerateWorld(const std::string& worldFile, int tilesX, int tilesY, float tileSize, int trianglesPerTile)
+{
+	std::ofstream file(worldFile, std::ios::binary);
+	if (!file)
+		return false;
+
+	// world centered around the origin
+	float originX = -tilesX * tileSize * 0.5f;
+	float originY = -tilesY * tileSize * 0.5f;
+
+	file.write(reinterpret_cast<const char*>(&tileSize), sizeof(float));
+	file.write(reinterpret_cast<const char*>(&originX), sizeof(float));
+	file.write(reinterpret_cast<const char*>(&originY), sizeof(float));
+	file.write(reinterpret_cast<const char*>(&tilesX), sizeof(int));
+	file.write(reinterpret_cast<const char*>(&tilesY), sizeof(int));
+
+	std::vector<TileEntry> tiles(tilesX * tilesY);
+	unsigned long long offset = 5 * 4 + tiles.size() * sizeof(TileEntry);
+
+	for (size_t i = 0; i < tiles.size(); ++i)
+	{
+		tiles[i].offset = offset;
+		tiles[i].count = trianglesPerTile;
+		offset += trianglesPerTile * 9 * sizeof(float);
+	}
+
+	file.write(reinterpret_cast<const char*>(tiles.data()), tiles.size() * sizeof(TileEntry));
+
+	for (int y = 0; y < tilesY; ++y)
+	{
+		for (int x = 0; x < tilesX; ++x)
+		{
+			for (int i = 0; i < trianglesPerTile; ++i)
+			{
+				float posX = originX + (x + (rand() % 1000) * 0.001f) * tileSize;
+				float posY = originY + (y + (rand() % 1000) * 0.001f) * tileSize;
+				Triangle triangle = Triangle::GenerateRandom({ 100.0f, 100.0f }, { posX, posY });
+
+				float data[9] = {
+					triangle.position.x, triangle.position.y,
+					triangle.localP0.x, triangle.localP0.y,
+					triangle.localP1.x, triangle.localP1.y,
+					triangle.localP2.x, triangle.localP2.y,
+					triangle.rotation
+				};
+
+				file.write(reinterpret_cast<const char*>(data), sizeof(data));
+			}
+		}
+	}
+
+	return static_cast<bool>(file);
+}
+
+bool WorldStreamer::Update(const sf::FloatRect& view, float prefetchMargin)
+{
+	bool changed = false;
+	++m_updateCount;
+	m_addedSlots.clear();
+	m_removedSlots.clear();
+
+	// take over finished loads
+	std::vector<LoadedTile> loaded;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		loaded.swap(m_loaded);
+	}
+
+	for (size_t i = 0; i < loaded.size(); ++i)
+	{
+		const TileKey& key = loaded[i].key;
+		m_pending.erase(key);
+
+		// the delay doubles with every attempt, after the last one the tile stays missing
+		if (loaded[i].failed)
+		{
+			LoadFailure& failure = m_failures[key];
+			++failure.attempts;
+			failure.retryUpdate = m_updateCount + (30u << std::min(failure.attempts, 8));
+			continue;
+		}
+
+		m_failures.erase(key);
+
+		std::vector<int>& slots = m_resident[key];
+		const std::vector<Triangle>& triangles = loaded[i].triangles;
+
+		for (size_t t = 0; t < triangles.size(); ++t)
+		{
+			int slot;
+			if (!m_freeSlots.empty())
+			{
+				slot = m_freeSlots.back();
+				m_freeSlots.pop_back();
+				m_triangles[slot] = triangles[t];
+			}
+			else
+			{
+				slot = static_cast<int>(m_triangles.size());
+				m_triangles.push_back(triangles[t]);
+				m_slotUsed.push_back(0);
+			}
+
+			m_slotUsed[slot] = 1;
+			slots.push_back(slot);
+			m_addedSlots.push_back(slot);
+		}
+
+		m_residentTriangles += triangles.size();
+		changed = true;
+	}
+
+	sf::FloatRect wanted(view.left - prefetchMargin, view.top - prefetchMargin, view.width + 2.0f * prefetchMargin, view.height + 2.0f * prefetchMargin);
+
+	int minX, maxX, minY, maxY;
+	TileRange(wanted, minX, maxX, minY, maxY);
+
+	int viewMinX, viewMaxX, viewMinY, viewMaxY;
+	TileRange(view, viewMinX, viewMaxX, viewMinY, viewMaxY);
+
+	float centerX = view.left + view.width * 0.5f;
+	float centerY = view.top + view.height * 0.5f;
+
+	auto distance = [this, centerX, centerY](const TileKey& key)
+	{
+		float dx = m_originX + (key.first + 0.5f) * m_tileSize - centerX;
+		float dy = m_originY + (key.second + 0.5f) * m_tileSize - centerY;
+		return dx * dx + dy * dy;
+	};
+
+	// missing tiles, nearest first
+	std::vector<TileKey> missing;
+	for (int y = minY; y <= maxY; ++y)
+	{
+		for (int x = minX; x <= maxX; ++x)
+		{
+			TileKey key(x, y);
+			if (m_resident.find(key) != m_resident.end() || m_pending.find(key) != m_pending.end())
+				continue;
+
+			auto failure = m_failures.find(key);
+			if (failure != m_failures.end() && (failure->second.attempts >= MaxLoadAttempts || m_updateCount < failure->second.retryUpdate))
+				continue;
+
+			missing.push_back(key);
+		}
+	}
+
+	std::sort(missing.begin(), missing.end(), [&distance](const TileKey& a, const TileKey& b) { return distance(a) < distance(b); });
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		// requests that are not wanted anymore are dropped before they get loaded
+		for (auto it = m_requests.begin(); it != m_requests.end();)
+		{
+			if (it->first < minX || it->first > maxX || it->second < minY || it->second > maxY)
+			{
+				m_pending.erase(*it);
+				it = m_requests.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+
+		for (size_t i = 0; i < missing.size(); ++i)
+		{
+			m_requests.push_back(missing[i]);
+			m_pending.insert(missing[i]);
+		}
+	}
+
+	if (!missing.empty())
+		m_requestCondition.notify_one();
+
+	// tiles one tile beyond the wanted range stay, so they do not get reloaded when the view moves back and forth
+	for (auto it = m_resident.begin(); it != m_resident.end();)
+	{
+		const TileKey& key = it->first;
+		if (key.first < minX - 1 || key.first > maxX + 1 || key.second < minY - 1 || key.second > maxY + 1)
+		{
+			EvictTile(it++);
+			changed = true;
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	// evict the farthest tiles outside the view while over the cap
+	if (GetResidentBytes() > m_memoryCap)
+	{
+		std::vector<TileKey> evictable;
+		for (auto it = m_resident.begin(); it != m_resident.end(); ++it)
+		{
+			const TileKey& key = it->first;
+			if (key.first < viewMinX || key.first > viewMaxX || key.second < viewMinY || key.second > viewMaxY)
+				evictable.push_back(key);
+		}
+
+		std::sort(evictable.begin(), evictable.end(), [&distance](const TileKey& a, const TileKey& b) { return distance(a) > distance(b); });
+
+		for (size_t i = 0; i < evictable.size() && GetResidentBytes() > m_memoryCap; ++i)
+		{
+			EvictTile(m_resident.find(evictable[i]));
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+void WorldStreamer::GetUsedSlots(std::vector<int>& slots) const
+{
+	slots.clear();
+
+	for (size_t i = 0; i < m_slotUsed.size(); ++i)
+	{
+		if (m_slotUsed[i] != 0)
+			slots.push_back(static_cast<int>(i));
+	}
+}
+
+/**
+ * The slots go back to the free list, their triangles stay in place
+ * until a later load reuses them
+ */
+void WorldStreamer::EvictTile(std::map<TileKey, std::vector<int>>::iterator it)
+{
+	const std::vector<int>& slots = it->second;
+
+	for (size_t i = 0; i < slots.size(); ++i)
+	{
+		m_slotUsed[slots[i]] = 0;
+		m_freeSlots.push_back(slots[i]);
+		m_removedSlots.push_back(slots[i]);
+	}
+
+	m_residentTriangles -= slots.size();
+	m_resident.erase(it);
+}
+
+void WorldStreamer::IOLoop(void)
+{
+	std::ifstream file(m_worldFile, std::ios::binary);
+
+	while (true)
+	{
+		TileKey key;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_requestCondition.wait(lock, [this] { return m_stop || !m_requests.empty(); });
+
+			if (m_stop)
+				return;
+
+			key = m_requests.front();
+			m_requests.pop_front();
+		}
+
+		LoadedTile tile;
+		tile.key = key;
+
+		{
+			TRACE_SCOPE("load tile");
+			tile.failed = !LoadTile(file, key, tile.triangles);
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_loaded.push_back(std::move(tile));
+	}
+}
+
+bool WorldStreamer::LoadTile(std::ifstream& file, const TileKey& key, std::vector<Triangle>& triangles)
+{
+	const TileEntry& entry = m_tiles[key.second * m_tilesX + key.first];
+
+	std::vector<float> data(entry.count * 9);
+
+	file.clear();
+	file.seekg(entry.offset);
+	file.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(float));
+
+	if (!file)
+		return false;
+
+	BoundsMode::Enum boundsMode = static_cast<BoundsMode::Enum>(m_boundsMode.load(std::memory_order_relaxed));
+	triangles.resize(entry.count);
+
+	for (unsigned int i = 0; i < entry.count; ++i)
+	{
+		const float* values = &data[i * 9];
+		Triangle& triangle = triangles[i];
+
+		triangle.position = { values[0], values[1] };
+		triangle.localP0 = { values[2], values[3] };
+		triangle.localP1 = { values[4], values[5] };
+		triangle.localP2 = { values[6], values[7] };
+
+		triangle.rotation = 0.0f;
+		triangle.cosRotation = 1.0f;
+		triangle.sinRotation = 0.0f;
+		triangle.CalculateBounds(boundsMode);
+		triangle.SetRotation(values[8]);
+
+		triangle.collisionStatus = CollisionStatus::None;
+	}
+
+	return true;
+}
+
+void WorldStreamer::TileRange(const sf::FloatRect& rect, int& minX, int& maxX, int& minY, int& maxY) const
+{
+	// clamped before the conversion, the view can be zoomed out arbitrarily far
+	auto tile = [this](float world, float origin, int tileCount)
+	{
+		float index = std::floor((world - origin) / m_tileSize);
+		return static_cast<int>(std::min(std::max(index, -1.0f), static_cast<float>(tileCount)));
+	};
+
+	minX = std::max(0, tile(rect.left, m_originX, m_tilesX));
+	maxX = std::min(m_tilesX - 1, tile(rect.left + rect.width, m_originX, m_tilesX));
+	minY = std::max(0, tile(rect.top, m_originY, m_tilesY));
+	maxY = std::min(m_tilesY - 1, tile(rect.top + rect.height, m_originY, m_tilesY));
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+
+#include "Triangle.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * Chunked world on disk, streamed in around the view
+ * The world file holds a grid of fixed-size tiles. Tiles around the view are
+ * loaded by a background thread, tiles more than one tile beyond the prefetch
+ * range are evicted. The memory cap is a hard limit on top of that, it evicts
+ * the farthest tiles outside the view. Tiles inside the view are never evicted.
+ *
+ * Resident triangles live in one slot array that the broad phase and the
+ * collision index directly. A slot keeps its index while its tile is resident,
+ * slots of evicted tiles are reused by later loads. Tiles that fail to load are
+ * retried with a growing delay and given up after a few attempts.
+ *
+ * File layout: header (tileSize, originX, originY, tilesX, tilesY), one
+ * (offset, count) entry per tile, then per triangle position, the three
+ * unrotated points and the rotation.
+ */
+class WorldStreamer
+{
+public:
+	WorldStreamer(const std::string& worldFile, size_t memoryCap);
+	~WorldStreamer();
+
+	static bool GenerateWorld(const std::string& worldFile, int tilesX, int tilesY, float tileSize, int trianglesPerTile);
+
+	bool IsOpen(void) const { return m_open; }
+
+	// bounds of tiles loaded from now on
+	void SetBoundsMode(BoundsMode::Enum boundsMode) { m_boundsMode.store(boundsMode, std::memory_order_relaxed); }
+
+	// requests missing tiles around the view, takes over finished loads and evicts, true if the resident set changed
+	bool Update(const sf::FloatRect& view, float prefetchMargin);
+
+	// slot array of all resident triangles, unused slots hold stale triangles
+	std::vector<Triangle>& GetTriangles(void) { return m_triangles; }
+	bool IsSlotUsed(int slot) const { return m_slotUsed[slot] != 0; }
+	// fills slots with the used slots in ascending order
+	void GetUsedSlots(std::vector<int>& slots) const;
+
+	// slots filled and freed by the last Update, a slot can be in both if its tile was evicted right away
+	const std::vector<int>& GetAddedSlots(void) const { return m_addedSlots; }
+	const std::vector<int>& GetRemovedSlots(void) const { return m_removedSlots; }
+
+	int GetResidentTileCount(void) const { return static_cast<int>(m_resident.size()); }
+	int GetPendingTileCount(void) const { return static_cast<int>(m_pending.size()); }
+	int GetFailedTileCount(void) const { return static_cast<int>(m_failures.size()); }
+	int GetResidentTriangleCount(void) const { return static_cast<int>(m_residentTriangles); }
+	size_t GetResidentBytes(void) const { return m_residentTriangles * sizeof(Triangle); }
+	// the slot array, resident triangles and the free slots between them
+	size_t GetStorageBytes(void) const { return m_triangles.size() * sizeof(Triangle); }
+
+private:
+	typedef std::pair<int, int> TileKey;
+
+	struct TileEntry
+	{
+		unsigned long long offset;
+		unsigned int count;
+	};
+
+	struct LoadedTile
+	{
+		TileKey key;
+		std::vector<Triangle> triangles;
+		// read error, the tile is requested again after a delay
+		bool failed;
+	};
+
+	struct LoadFailure
+	{
+		int attempts;
+		unsigned int retryUpdate;
+	};
+
+	static const int MaxLoadAttempts = 5;
+
+	void IOLoop(void);
+	void EvictTile(std::map<TileKey, std::vector<int>>::iterator it);
+	bool LoadTile(std::ifstream& file, const TileKey& key, std::vector<Triangle>& triangles);
+	void TileRange(const sf::FloatRect& rect, int& minX, int& maxX, int& minY, int& maxY) const;
+
+	bool m_open;
+	float m_tileSize;
+	float m_originX;
+	float m_originY;
+	int m_tilesX;
+	int m_tilesY;
+	std::vector<TileEntry> m_tiles;
+	std::string m_worldFile;
+	size_t m_memoryCap;
+	std::atomic<int> m_boundsMode;
+
+	// main thread only, resident tiles map to their slots
+	std::map<TileKey, std::vector<int>> m_resident;
+	std::set<TileKey> m_pending;
+	std::map<TileKey, LoadFailure> m_failures;
+	unsigned int m_updateCount;
+	size_t m_residentTriangles;
+
+	std::vector<Triangle> m_triangles;
+	std::vector<unsigned char> m_slotUsed;
+	std::vector<int> m_freeSlots;
+	std::vector<int> m_addedSlots;
+	std::vector<int> m_removedSlots;
+
+	// shared with the io thread
+	std::thread m_ioThread;
+	std::mutex m_mutex;
+	std::condition_variable m_requestCondition;
+	std::deque<TileKey> m_requests;
+	std::vector<LoadedTile> m_loaded;
+	bool m_stop;
+};
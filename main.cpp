@@ -1,8 +1,21 @@
 #include <SFML/Graphics.hpp>
 #include <glm/glm.hpp>
 
+#include "BatchQuery.h"
+#include "CollisionIslands.h"
+#include "DebugDraw.h"
 #include "FPSCounter.h"
+#include "HierarchicalGrid.h"
+#include "StatsOverlay.h"
+#include "ThreadPool.h"
+#include "Trace.h"
 #include "Triangle.h"
+#include "WorldStreamer.h"
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
 
 int main()
 {
@@ -23,108 +36,469 @@ int main()
 	srand(time(NULL));
 
 	FPSCounter fpsCounter("Assets/Font/digital_counter_7.ttf");
+	StatsOverlay statsOverlay("Assets/Font/digital_counter_7.ttf");
 	sf::Color clearColor(38, 11, 1);
 
-	Triangle movingTriangle = Triangle::GenerateRandom({ 100.0f, 100.0f }, { 0.0f, 0.0f });
+	BoundsMode::Enum boundsMode = BoundsMode::Fast;
+
+	// every interval frames both bounds modes count their stages on the same pairs,
+	// to show how many narrow phase tests the tight bounds save
+	const unsigned int boundsComparisonInterval = 60;
+	unsigned int frameNumber = 0;
+	CollisionStats comparisonStats[2] = {};
+
+	Triangle movingTriangle = Triangle::GenerateRandom({ 100.0f, 100.0f }, { 0.0f, 0.0f }, boundsMode);
+
+	// agents following the cursor, tested against the static triangles as one batch
+	const int agentCount = 200;
+	bool agentsActive = false;
+	std::vector<Triangle> agents;
+	std::vector<glm::vec2> agentOffsets;
+	BatchQuery agentQuery;
+
+	for (int i = 0; i < agentCount; ++i)
+	{
+		agents.emplace_back(Triangle::GenerateRandom({ 60.0f, 60.0f }, { 0.0f, 0.0f }, boundsMode));
+		agentOffsets.emplace_back(glm::vec2(rand() % 1200 - 600, rand() % 1200 - 600));
+	}
+
+	// the world lives on disk in tiles, only the ones around the view are resident
+	const std::string worldFile = "world.bin";
+	const size_t worldMemoryCap = 2 * 1024 * 1024;
+	const float prefetchMargin = 512.0f;
 
-	int staticTriangleCount = 300;
-	std::vector<Triangle> staticTriangles;
-	staticTriangles.reserve(staticTriangleCount);
-	for (int i = 0; i < staticTriangleCount; ++i)
+	if (!std::ifstream(worldFile))
+		WorldStreamer::GenerateWorld(worldFile, 64, 64, 512.0f, 10);
+
+	WorldStreamer world(worldFile, worldMemoryCap);
+	if (!world.IsOpen())
 	{
-		float x = rand() % (1920 * 2) - 960;
-		float y = rand() % (1080 * 2) - 540;
-		staticTriangles.emplace_back(Triangle::GenerateRandom({ 100.0f, 100.0f }, { x, y }));
+		std::cerr << "could not open " << worldFile << std::endl;
+		return 1;
 	}
+	world.SetBoundsMode(boundsMode);
+
+	// the streamer's slot array is the only copy of the static triangles, indices stay stable while their tile is resident
+	std::vector<Triangle>& staticTriangles = world.GetTriangles();
+	int staticTriangleCount = 0;
+	std::vector<int> residentSlots;
+
+	// spinning of the static triangles, each with its own angular velocity
+	bool spinning = false;
+	std::vector<int> spinIndices;
+	std::vector<float> spinVelocities;
+	std::vector<float> spinRotations;
+
+	// broad phase, refit when the static triangles spin and rebuilt when tiles stream in and out
+	HierarchicalGrid grid;
+	std::vector<int> candidates;
+	std::vector<int> visibleTriangles;
+
+	// connected groups of colliding static triangles, resting groups skip detection
+	ThreadPool threadPool;
+	CollisionIslands islands;
+	std::vector<CollisionPair> collisionPairs;
+
+	// trace capture, either a fixed range of frames or every frame slower than the threshold
+	const unsigned int captureFrames = 120;
+	const long long slowFrameThreshold = 25000000;
+	unsigned int captureEndFrame = 0;
+	bool captureSlowFrames = false;
+	unsigned int slowFrameCooldown = 0;
 
 	sf::Clock deltaClock;
 	sf::Time dt;
 	while (window.isOpen())
 	{
+		Trace::BeginFrame();
+		long long frameStart = Trace::Now();
+		++frameNumber;
+
 		dt = deltaClock.restart();
 		window.setView(gameView);
 
 		sf::Vector2i mousePosPixel = sf::Mouse::getPosition(window);
 		sf::Vector2f mousePosWorld = window.mapPixelToCoords(mousePosPixel);
 
-		sf::Event event;
-		while (window.pollEvent(event))
 		{
-			if (event.type == sf::Event::Closed || (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Escape))
-				window.close();
+			TRACE_SCOPE("input");
 
-			// key press events
-			if (event.type == sf::Event::KeyPressed)
+			sf::Event event;
+			while (window.pollEvent(event))
 			{
-				if (event.key.code == sf::Keyboard::R)
+				if (event.type == sf::Event::Closed || (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Escape))
+					window.close();
+
+				// key press events
+				if (event.type == sf::Event::KeyPressed)
 				{
-					movingTriangle = Triangle::GenerateRandom({ 100.0f, 100.0f }, { 0.0f, 0.0f });
+					if (event.key.code == sf::Keyboard::R)
+					{
+						movingTriangle = Triangle::GenerateRandom({ 100.0f, 100.0f }, { 0.0f, 0.0f }, boundsMode);
+					}
+					else if (event.key.code == sf::Keyboard::S)
+					{
+						// toggle spinning of the static triangles
+						spinning = !spinning;
+					}
+					else if (event.key.code == sf::Keyboard::B)
+					{
+						// switch between fast and tight bounding volumes
+						boundsMode = boundsMode == BoundsMode::Fast ? BoundsMode::Tight : BoundsMode::Fast;
+
+						for (size_t i = 0; i < residentSlots.size(); ++i)
+						{
+							staticTriangles[residentSlots[i]].CalculateBounds(boundsMode);
+						}
+						movingTriangle.CalculateBounds(boundsMode);
+						world.SetBoundsMode(boundsMode);
+
+						for (size_t i = 0; i < agents.size(); ++i)
+						{
+							agents[i].CalculateBounds(boundsMode);
+						}
+
+						grid.Build(staticTriangles, residentSlots);
+						islands.WakeAll();
+					}
+					else if (event.key.code == sf::Keyboard::A)
+					{
+						// toggle the agents around the cursor
+						agentsActive = !agentsActive;
+					}
+					else if (event.key.code == sf::Keyboard::P)
+					{
+						// capture the next frames into a trace file
+						captureEndFrame = Trace::GetFrame() + captureFrames;
+						Trace::SetEnabled(true);
+					}
+					else if (event.key.code == sf::Keyboard::L)
+					{
+						// toggle writing a trace file for every slow frame
+						captureSlowFrames = !captureSlowFrames;
+						Trace::SetEnabled(captureSlowFrames || captureEndFrame != 0);
+					}
+					else if (event.key.code == sf::Keyboard::D)
+					{
+						// toggle recording of debug geometry
+						DebugDraw::SetEnabled(!DebugDraw::IsEnabled());
+						DebugDraw::Discard();
+					}
 				}
-			}
 
-			// mouse scrool events
-			if (event.type == sf::Event::MouseWheelScrolled)
-			{
-				if (event.mouseWheelScroll.delta > 0.0f)
+				// mouse scrool events
+				if (event.type == sf::Event::MouseWheelScrolled)
+				{
+					if (event.mouseWheelScroll.delta > 0.0f)
+					{
+						gameView.zoom(0.9f);
+						zoom *= 0.9f;
+					}
+					else if (event.mouseWheelScroll.delta < 0.0f)
+					{
+						gameView.zoom(1.1f);
+						zoom *= 1.1f;
+					}
+				}
+
+				// mouse button events
+				if (event.type == sf::Event::MouseButtonPressed)
 				{
-					gameView.zoom(0.9f);
-					zoom *= 0.9f;
+					if (event.mouseButton.button == sf::Mouse::Middle)
+						middleMousePressed = true;
 				}
-				else if (event.mouseWheelScroll.delta < 0.0f)
+
+				if (event.type == sf::Event::MouseButtonReleased)
 				{
-					gameView.zoom(1.1f);
-					zoom *= 1.1f;
+					if (event.mouseButton.button == sf::Mouse::Middle)
+						middleMousePressed = false;
 				}
 			}
 
-			// mouse button events
-			if (event.type == sf::Event::MouseButtonPressed)
+			if (middleMousePressed)
 			{
-				if (event.mouseButton.button == sf::Mouse::Middle)
-					middleMousePressed = true;
+				sf::Vector2f mouseDelta(sf::Vector2f(lastMousePos.x - mousePosPixel.x, lastMousePos.y - mousePosPixel.y));
+				gameView.move(zoom * mouseDelta);
 			}
+			lastMousePos = mousePosPixel;
+		}
+
+		// visible part of the world, the view size already includes the zoom
+		sf::Vector2f viewCenter = gameView.getCenter();
+		sf::Vector2f viewSize = gameView.getSize();
+		sf::FloatRect viewRect(viewCenter.x - viewSize.x * 0.5f, viewCenter.y - viewSize.y * 0.5f, viewSize.x, viewSize.y);
+
+		// stream tiles around the view in and out
+		{
+			TRACE_SCOPE("streaming");
 
-			if (event.type == sf::Event::MouseButtonReleased)
+			// only the slots of arrived and evicted tiles touch the grid and the islands
+			if (world.Update(viewRect, prefetchMargin))
 			{
-				if (event.mouseButton.button == sf::Mouse::Middle)
-					middleMousePressed = false;
+				staticTriangleCount = static_cast<int>(staticTriangles.size());
+				spinVelocities.resize(staticTriangleCount);
+
+				const std::vector<int>& added = world.GetAddedSlots();
+				for (size_t i = 0; i < added.size(); ++i)
+				{
+					const Triangle& triangle = staticTriangles[added[i]];
+
+					// derived from the position so it survives streaming
+					spinVelocities[added[i]] = 2.0f * std::sin(triangle.position.x * 12.9898f + triangle.position.y * 78.233f);
+
+					grid.Insert(added[i], triangle);
+					islands.Detach(added[i]);
+				}
+
+				// after the additions, a slot in both lists belongs to a tile evicted right after it arrived
+				const std::vector<int>& removed = world.GetRemovedSlots();
+				for (size_t i = 0; i < removed.size(); ++i)
+				{
+					grid.Remove(removed[i]);
+					islands.Detach(removed[i]);
+				}
+
+				world.GetUsedSlots(residentSlots);
+				spinIndices = residentSlots;
+				spinRotations.resize(spinIndices.size());
 			}
+
+			statsOverlay.SetLine("tiles", std::to_string(world.GetResidentTileCount()) + " +" + std::to_string(world.GetPendingTileCount()) + " !" + std::to_string(world.GetFailedTileCount()));
+			statsOverlay.SetLine("resident kb", std::to_string(world.GetStorageBytes() / 1024));
+			statsOverlay.SetLine("triangles", std::to_string(world.GetResidentTriangleCount()));
 		}
 
-		if (middleMousePressed)
+		// updates
 		{
-			sf::Vector2f mouseDelta(sf::Vector2f(lastMousePos.x - mousePosPixel.x, lastMousePos.y - mousePosPixel.y));
-			gameView.move(zoom * mouseDelta);
+			TRACE_SCOPE("update");
+
+			fpsCounter.Update(dt);
+			movingTriangle.position = { mousePosWorld.x, mousePosWorld.y };
+
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Q))
+				movingTriangle.SetRotation(movingTriangle.rotation - 2.0f * dt.asSeconds());
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::E))
+				movingTriangle.SetRotation(movingTriangle.rotation + 2.0f * dt.asSeconds());
+
+			if (spinning)
+			{
+				for (size_t i = 0; i < spinIndices.size(); ++i)
+				{
+					spinRotations[i] = staticTriangles[spinIndices[i]].rotation + spinVelocities[spinIndices[i]] * dt.asSeconds();
+				}
+
+				Triangle::SetRotations(staticTriangles, spinIndices, spinRotations);
+
+				// the radius does not change with the rotation, only triangles whose circle center changed cells are moved
+				grid.Refit(staticTriangles, spinIndices);
+
+				for (size_t i = 0; i < spinIndices.size(); ++i)
+				{
+					islands.Wake(spinIndices[i]);
+				}
+			}
 		}
-		lastMousePos = mousePosPixel;
 
-		// updates
-		fpsCounter.Update(dt);
-		movingTriangle.position = { mousePosWorld.x, mousePosWorld.y };
+		CollisionStats& stats = CollisionStats::Current();
+		stats.Reset();
 
-		// test collision between static triangles
-		for (size_t i = 0; i < staticTriangleCount; ++i)
 		{
-			staticTriangles[i].CalculateCollision(staticTriangles);
+			TRACE_SCOPE("collision");
+
+			// test collision between static triangles, sleeping ones keep their last result
+			{
+				TRACE_SCOPE("static pass");
+
+				collisionPairs.clear();
+				islands.RetainSleepingPairs(collisionPairs);
+
+				for (size_t i = 0; i < staticTriangleCount; ++i)
+				{
+					if (!world.IsSlotUsed(i) || islands.IsAsleep(i))
+						continue;
+
+					grid.Query(staticTriangles[i], candidates);
+					staticTriangles[i].CalculateCollision(staticTriangles, candidates, i, collisionPairs);
+				}
+			}
+
+			// the broad phase pairs of this frame, counted once with the bounds of each mode
+			if (frameNumber % boundsComparisonInterval == 0)
+			{
+				TRACE_SCOPE("bounds comparison");
+
+				BoundsMode::Enum otherMode = boundsMode == BoundsMode::Fast ? BoundsMode::Tight : BoundsMode::Fast;
+
+				// only alive for the comparison, so the triangles are not held twice in between
+				std::vector<Triangle> comparisonTriangles(staticTriangles);
+				for (size_t i = 0; i < residentSlots.size(); ++i)
+				{
+					comparisonTriangles[residentSlots[i]].CalculateBounds(otherMode);
+				}
+
+				const std::vector<Triangle>* modeTriangles[2];
+				modeTriangles[boundsMode] = &staticTriangles;
+				modeTriangles[otherMode] = &comparisonTriangles;
+
+				comparisonStats[BoundsMode::Fast].Reset();
+				comparisonStats[BoundsMode::Tight].Reset();
+
+				for (size_t r = 0; r < residentSlots.size(); ++r)
+				{
+					const int i = residentSlots[r];
+					grid.Query(staticTriangles[i], candidates);
+
+					for (size_t c = 0; c < candidates.size(); ++c)
+					{
+						if (candidates[c] == i)
+							continue;
+
+						for (int m = 0; m < 2; ++m)
+						{
+							CollisionChecks::CountStages((*modeTriangles[m])[i], (*modeTriangles[m])[candidates[c]], comparisonStats[m]);
+						}
+					}
+				}
+			}
+
+			// test collision from the moving triangle, everything it gets close to wakes up
+			{
+				TRACE_SCOPE("cursor pass");
+
+				grid.Query(movingTriangle, candidates);
+				movingTriangle.CalculateCollision(staticTriangles, candidates);
+
+				for (size_t i = 0; i < candidates.size(); ++i)
+				{
+					islands.Wake(candidates[i]);
+				}
+			}
+
+			// agent tests are reported on their own line
+			const unsigned int staticMinkowskiTests = stats.minkowskiTests;
+
+			// agents as one packet query
+			if (agentsActive)
+			{
+				TRACE_SCOPE("agent pass");
+
+				for (size_t i = 0; i < agents.size(); ++i)
+				{
+					agents[i].position = movingTriangle.position + agentOffsets[i];
+				}
+
+				agentQuery.Run(agents, staticTriangles, grid);
+
+				const std::vector<int>& touched = agentQuery.GetTouched();
+				for (size_t i = 0; i < touched.size(); ++i)
+				{
+					islands.Wake(touched[i]);
+				}
+
+				statsOverlay.SetLine("agent hits", std::to_string(agentQuery.GetTotalHitCount()) + " in " + std::to_string(agentQuery.GetPacketCount()) + " packets");
+				statsOverlay.SetLine("agent minkowski", std::to_string(stats.minkowskiTests - staticMinkowskiTests));
+			}
+			else
+			{
+				statsOverlay.SetLine("agent hits", "off");
+				statsOverlay.SetLine("agent minkowski", "off");
+			}
+
+			{
+				TRACE_SCOPE("islands");
+				islands.Build(staticTriangleCount, collisionPairs, &threadPool);
+			}
 		}
 
-		// test collision from the moving triangle
-		movingTriangle.CalculateCollision(staticTriangles);
+		// the debug geometry of this frame is complete, the next collision pass records into the other buffers
+		DebugDraw::EndFrame();
+
+		statsOverlay.SetLine("bounds", boundsMode == BoundsMode::Tight ? "tight" : "fast");
+		statsOverlay.SetLine("circle", std::to_string(stats.circleTests));
+		statsOverlay.SetLine("aabb", std::to_string(stats.aabbTests));
+		statsOverlay.SetLine("obb", std::to_string(stats.obbTests));
+		statsOverlay.SetLine("minkowski", std::to_string(stats.minkowskiTests));
+		statsOverlay.SetLine("hits", std::to_string(stats.hits));
+		statsOverlay.SetLine("islands", std::to_string(islands.GetIslandCount()));
+		statsOverlay.SetLine("sleeping", std::to_string(islands.GetSleepingCount()));
+		statsOverlay.SetLine("minkowski fast/tight", std::to_string(comparisonStats[BoundsMode::Fast].minkowskiTests) + "/" + std::to_string(comparisonStats[BoundsMode::Tight].minkowskiTests));
+		statsOverlay.SetLine("tight saves", std::to_string(static_cast<int>(comparisonStats[BoundsMode::Fast].minkowskiTests) - static_cast<int>(comparisonStats[BoundsMode::Tight].minkowskiTests)));
 
-		window.clear(clearColor);
-		
 		// draws
-		for (size_t i = 0; i < staticTriangleCount; ++i)
 		{
-			staticTriangles[i].Draw(window);
+			TRACE_SCOPE("draw");
+
+			window.clear(clearColor);
+
+			// only triangles whose bounding circle or AABB and OBB overlays touch the view
+			float overhang = grid.GetMaxOverlayOverhang();
+			grid.QueryRect({ viewRect.left, viewRect.top }, { viewRect.left + viewRect.width, viewRect.top + viewRect.height }, visibleTriangles, overhang);
+
+			int drawnCount = 0;
+			for (size_t i = 0; i < visibleTriangles.size(); ++i)
+			{
+				Triangle& triangle = staticTriangles[visibleTriangles[i]];
+				glm::vec2 center = triangle.position + triangle.bCircleCenter;
+				float reach = triangle.bCircleRadius + triangle.CalculateOverlayOverhang();
+
+				if (center.x + reach < viewRect.left || center.x - reach > viewRect.left + viewRect.width ||
+					center.y + reach < viewRect.top || center.y - reach > viewRect.top + viewRect.height)
+					continue;
+
+				triangle.Draw(window);
+				++drawnCount;
+			}
+
+			statsOverlay.SetLine("culled", std::to_string(world.GetResidentTriangleCount() - drawnCount));
+
+			if (agentsActive)
+			{
+				for (size_t i = 0; i < agents.size(); ++i)
+				{
+					agents[i].Draw(window);
+				}
+			}
+
+			movingTriangle.Draw(window);
+
+			// debug geometry recorded during the collision pass
+			if (DebugDraw::IsEnabled())
+				DebugDraw::Flush(window);
+
+			window.setView(hudView);
+			fpsCounter.Draw(window);
+			statsOverlay.Draw(window);
 		}
 
-		movingTriangle.Draw(window);
+		{
+			TRACE_SCOPE("display");
+			window.display();
+		}
+
+		if (Trace::IsEnabled())
+		{
+			long long frameEnd = Trace::Now();
+			unsigned int frame = Trace::GetFrame();
 
-		window.setView(hudView);
-		fpsCounter.Draw(window);
+			Trace::Record("frame", frameStart, frameEnd);
+			Trace::Collect();
 
-		window.display();
+			statsOverlay.SetLine("trace dropped", std::to_string(Trace::GetDroppedCount()));
+
+			if (captureEndFrame != 0 && frame >= captureEndFrame)
+			{
+				Trace::WriteChromeTrace("trace_" + std::to_string(captureEndFrame - captureFrames + 1) + "_" + std::to_string(captureEndFrame) + ".json", captureEndFrame - captureFrames + 1, captureEndFrame);
+				captureEndFrame = 0;
+				Trace::SetEnabled(captureSlowFrames);
+			}
+
+			if (captureSlowFrames && frameEnd - frameStart > slowFrameThreshold && frame >= slowFrameCooldown)
+			{
+				// include the frames before the spike for context
+				Trace::WriteChromeTrace("trace_slow_" + std::to_string(frame) + ".json", frame > 2 ? frame - 2 : 0, frame);
+				slowFrameCooldown = frame + captureFrames;
+			}
+		}
 	}
 
 	return 0;